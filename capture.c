@@ -0,0 +1,116 @@
+/*
+ * Timestamped serial captures
+ *
+ * See capture.h.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+static unsigned char *read_file(const char *path, size_t *len)
+{
+	unsigned char *buf;
+	FILE *f;
+	long n;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+	if (fseek(f, 0, SEEK_END) || (n = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET)) {
+		fclose(f);
+		return NULL;
+	}
+	buf = malloc(n ? n : 1);
+	if (buf && fread(buf, 1, n, f) != (size_t)n) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	*len = n;
+	return buf;
+}
+
+/* Decodes a varint at buf[*pos], short of end.  Returns -1 if it runs
+ * past end. */
+static int get_varint(const unsigned char *buf, size_t *pos, size_t end,
+		      uint64_t *v)
+{
+	int shift;
+
+	*v = 0;
+	for (shift = 0; *pos < end && shift < 64; shift += 7) {
+		unsigned char b = buf[(*pos)++];
+
+		*v |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return 0;
+	}
+	return -1;
+}
+
+/*
+ * The data is moved down over the chunk headers, in place.  A capture
+ * that was cut off (inputattach killed before it could flush) ends in
+ * the middle of a chunk; that chunk is dropped.
+ */
+int capture_load(struct capture *c, const char *path)
+{
+	struct capture_header h;
+	uint64_t time = 0, delta, n;
+	size_t len, pos;
+
+	memset(c, 0, sizeof(*c));
+	c->data = read_file(path, &len);
+	if (!c->data)
+		return -1;
+
+	if (len < sizeof(h) ||
+	    memcmp(c->data, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN)) {
+		c->len = len;
+		return 0;
+	}
+	memcpy(&h, c->data, sizeof(h));
+	if (h.version != CAPTURE_VERSION) {
+		capture_free(c);
+		errno = EINVAL;
+		return -1;
+	}
+	c->baud = h.baud;
+
+	/* Each chunk takes at least two bytes. */
+	c->chunks = malloc((len / 2 + 1) * sizeof(*c->chunks));
+	if (!c->chunks) {
+		capture_free(c);
+		return -1;
+	}
+	for (pos = sizeof(h); pos < len; pos += n) {
+		if (get_varint(c->data, &pos, len, &delta) ||
+		    get_varint(c->data, &pos, len, &n) || n > len - pos)
+			break;
+		/* Times only go forward; a delta that wraps them round
+		 * is damage, not a very long pause. */
+		if (time + delta < time) {
+			capture_free(c);
+			errno = EINVAL;
+			return -1;
+		}
+		time += delta;
+		memmove(c->data + c->len, c->data + pos, n);
+		c->len += n;
+		c->chunks[c->nchunks].time = time;
+		c->chunks[c->nchunks++].len = n;
+	}
+	return 0;
+}
+
+void capture_free(struct capture *c)
+{
+	free(c->data);
+	free(c->chunks);
+	memset(c, 0, sizeof(*c));
+}
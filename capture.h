@@ -0,0 +1,70 @@
+/*
+ * Timestamped serial captures, as written by inputattach --capture
+ *
+ * A file is a struct capture_header, then any number of chunks, each
+ * the bytes one read() returned, preceded by two varints: the time in
+ * microseconds since the previous chunk (or since the start, for the
+ * first), and the number of bytes.  A varint is 7 bits per byte, least
+ * significant first, with the top bit set on all but the last byte.
+ * At tablet rates that makes a chunk header two to four bytes.
+ *
+ * The header is in the byte order of the machine that made the
+ * capture.  Anything without the magic is taken to be a raw byte dump,
+ * as from inputattach --dump, with no times.
+ *
+ * Userspace only; the loader is in libwacom_iv.a.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAPTURE_MAGIC		"SERCAP\r\n"
+#define CAPTURE_MAGIC_LEN	8
+#define CAPTURE_VERSION		2
+/* Longest encoding of a 64-bit varint */
+#define CAPTURE_VARINT_MAX	10
+
+struct capture_header {
+	char magic[CAPTURE_MAGIC_LEN];
+	uint32_t version;
+	uint32_t baud;		/* line speed, or 0 if not known */
+	uint64_t start;		/* CLOCK_REALTIME when the file was begun, ns */
+};
+
+/* A chunk as loaded, not as stored */
+struct capture_chunk {
+	uint64_t time;		/* when read() returned, us after start */
+	uint32_t len;
+};
+
+struct capture {
+	uint32_t baud;		/* 0 if not known */
+	/* Every chunk's bytes, back to back */
+	unsigned char *data;
+	size_t len;
+	/* NULL for a raw dump */
+	struct capture_chunk *chunks;
+	size_t nchunks;
+};
+
+/* Returns -1 with errno set on failure; EINVAL for a damaged file. */
+int capture_load(struct capture *c, const char *path);
+void capture_free(struct capture *c);
+
+/* Encodes v at p, and returns its length. */
+static inline int capture_put_varint(unsigned char *p, uint64_t v)
+{
+	int n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = v | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+
+#endif
@@ -37,12 +37,19 @@
 #include <fcntl.h>
 #include <linux/serio.h>
 #include "serio-ids.h"
+#include "capture.h"
+#include "termios2.h"
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
 
 static int readchar(int fd, unsigned char *c, int timeout)
 {
@@ -83,6 +90,22 @@ static void setline(int fd, int flags, int speed)
 	tcsetattr(fd, TCSANOW, &t);
 }
 
+static int baud_to_speed(int baud)
+{
+	switch (baud) {
+	case 1200: return B1200;
+	case 2400: return B2400;
+	case 4800: return B4800;
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	default: return B0;
+	}
+}
+
 static int logitech_command(int fd, char *c)
 {
 	int i;
@@ -438,6 +461,10 @@ static int zhenhua_init(int fd, unsigned long *id, unsigned long *extra)
 		
 }
 
+/* Set by --capture: the device is to be recorded rather than
+ * attached, so init functions should leave it sending. */
+static const char *capture_path;
+
 static int dump_init(int fd, unsigned long *id, unsigned long *extra)
 {
 	unsigned char c, o = 0;
@@ -447,6 +474,9 @@ static int dump_init(int fd, unsigned long *id, unsigned long *extra)
 	if (write(fd, &c, 1) != 1)         /* Enable command */
                 return -1;
 
+	if (capture_path)
+		return 0;
+
 	while (1)
 		if (!readchar(fd, &c, 1)) {
 			printf("%02x (%c) ", c, ((c > 32) && (c < 127)) ? c : 'x');
@@ -462,37 +492,126 @@ static int dump_init(int fd, unsigned long *id, unsigned long *extra)
 #define WACOM_IV_RESET_BAUD "\r$"
 #define WACOM_IV_RESET "\r#"
 #define WACOM_IV_STOP "SP\r"
-enum { WACOM_IV_RESET_BAUD_LEN = 2, WACOM_IV_RESET_LEN = 2, WACOM_IV_STOP_LEN = 3 };
+#define WACOM_IV_START "ST\r"
+#define WACOM_IV_QUERY_MODEL "~#"
+enum { WACOM_IV_RESET_BAUD_LEN = 2, WACOM_IV_RESET_LEN = 2, WACOM_IV_STOP_LEN = 3,
+       WACOM_IV_START_LEN = 3, WACOM_IV_QUERY_MODEL_LEN = 2 };
+
+/* Fastest first.  The driver is told the rate in the serio id, in
+ * units of 1200 baud, to work out how long packets take to arrive. */
+static const struct {
+	int speed;
+	int baud;
+	const char *command;
+} wacom_iv_rates[] = {
+	{ B38400, 38400, "BA38\r" },
+	{ B19200, 19200, "BA19\r" },
+	{ B9600, 9600, "BA96\r" },
+};
+#define WACOM_IV_NRATES (sizeof(wacom_iv_rates) / sizeof(wacom_iv_rates[0]))
 
-static int wacom_iv_init(int fd, unsigned long *id, unsigned long *extra)
+/* Ask for the model and version, to check that we're talking to a
+ * tablet at the current line speed.  Waits at most timeout ms for
+ * the response to start. */
+static int wacom_iv_query_model(int fd, char *buf, int size, int timeout)
 {
-	setline(fd, CS8 | CRTSCTS, B38400);
-	if (write(fd, WACOM_IV_RESET_BAUD, WACOM_IV_RESET_BAUD_LEN) != WACOM_IV_RESET_BAUD_LEN)
-		return -1;
-	usleep(250 * 1000);
-	if (write(fd, WACOM_IV_RESET, WACOM_IV_RESET_LEN) != WACOM_IV_RESET_LEN)
-		return -1;
-	usleep(75 * 1000);
+	unsigned char c;
+	int i = 0, n;
 
-	setline(fd, CS8 | CRTSCTS, B19200);
-	if (write(fd, WACOM_IV_RESET_BAUD, WACOM_IV_RESET_BAUD_LEN) != WACOM_IV_RESET_BAUD_LEN)
-		return -1;
-	usleep(250 * 1000);
-	if (write(fd, WACOM_IV_RESET, WACOM_IV_RESET_LEN) != WACOM_IV_RESET_LEN)
+	tcflush(fd, TCIFLUSH);
+	if (write(fd, WACOM_IV_QUERY_MODEL, WACOM_IV_QUERY_MODEL_LEN) != WACOM_IV_QUERY_MODEL_LEN)
 		return -1;
-	usleep(75 * 1000);
 
-	setline(fd, CS8 | CRTSCTS, B9600);
-	if (write(fd, WACOM_IV_RESET_BAUD, WACOM_IV_RESET_BAUD_LEN) != WACOM_IV_RESET_BAUD_LEN)
-		return -1;
-	usleep(250 * 1000);
+	/* Skip anything left over from before the request (packets,
+	 * if the tablet is streaming), and stop at the first pause,
+	 * since some tablets (the PenPartner, for example) don't end
+	 * their responses with a CR. */
+	for (n = 0; n < 256 && i < size - 1; n++) {
+		if (readchar(fd, &c, i ? 20 : timeout))
+			break;
+		if (c == '\r')
+			break;
+		if (i == 0 && c != '~')
+			continue;
+		buf[i++] = c;
+	}
+	buf[i] = 0;
+
+	return (i > 2 && buf[1] == '#') ? 0 : -1;
+}
+
+/* Find the rate the tablet is talking at now, by asking it for its
+ * model at each candidate rate.  Returns an index into
+ * wacom_iv_rates, or -1. */
+static int wacom_iv_find_rate(int fd)
+{
+	char model[64];
+	int i;
+
+	for (i = 0; i < WACOM_IV_NRATES; i++) {
+		setline(fd, CS8 | CRTSCTS, wacom_iv_rates[i].speed);
+		if (write(fd, WACOM_IV_STOP, WACOM_IV_STOP_LEN) != WACOM_IV_STOP_LEN)
+			return -1;
+		if (!wacom_iv_query_model(fd, model, sizeof(model), 100))
+			return i;
+	}
+	return -1;
+}
+
+static int wacom_iv_init(int fd, unsigned long *id, unsigned long *extra)
+{
+	char model[64];
+	int i, rate;
+
+	rate = wacom_iv_find_rate(fd);
+	if (rate < 0) {
+		/* Nothing answered.  Reset the link speed to 9600 at
+		 * every rate, and look again. */
+		for (i = 0; i < WACOM_IV_NRATES; i++) {
+			setline(fd, CS8 | CRTSCTS, wacom_iv_rates[i].speed);
+			if (write(fd, WACOM_IV_RESET_BAUD, WACOM_IV_RESET_BAUD_LEN) != WACOM_IV_RESET_BAUD_LEN)
+				return -1;
+			tcdrain(fd);
+		}
+		rate = wacom_iv_find_rate(fd);
+		if (rate < 0)
+			return -1;
+	}
+
+	/* Make sure it's speaking binary protocol IV, and quiet.  The
+	 * model query returns as soon as the reset is over. */
 	if (write(fd, WACOM_IV_RESET, WACOM_IV_RESET_LEN) != WACOM_IV_RESET_LEN)
 		return -1;
-	usleep(75 * 1000);
+	if (wacom_iv_query_model(fd, model, sizeof(model), 250))
+		return -1;
 	if (write(fd, WACOM_IV_STOP, WACOM_IV_STOP_LEN) != WACOM_IV_STOP_LEN)
 		return -1;
-	usleep(30 * 1000);
 
+	/* Move to the fastest rate the tablet will confirm with a
+	 * model query, falling back one step at a time. */
+	for (i = 0; i < rate; i++) {
+		int len = strlen(wacom_iv_rates[i].command);
+
+		if (write(fd, wacom_iv_rates[i].command, len) != len)
+			return -1;
+		tcdrain(fd);
+		setline(fd, CS8 | CRTSCTS, wacom_iv_rates[i].speed);
+		if (!wacom_iv_query_model(fd, model, sizeof(model), 100)) {
+			rate = i;
+			break;
+		}
+		/* It may or may not have switched. */
+		rate = wacom_iv_find_rate(fd);
+		if (rate < 0)
+			return -1;
+	}
+
+	*id = wacom_iv_rates[rate].baud / 1200;
+
+	/* The driver starts it when someone opens the input device. */
+	if (capture_path &&
+	    write(fd, WACOM_IV_START, WACOM_IV_START_LEN) != WACOM_IV_START_LEN)
+		return -1;
 	return 0;
 }
 
@@ -637,6 +756,18 @@ static void show_help(void)
 
 	puts("");
 	puts("Usage: inputattach [--daemon] [--baud <baud>] [--always] [--noinit] <mode> <device>");
+	puts("       inputattach [--daemon] [--baud <baud>] [--always] [--noinit]");
+	puts("                   [--config <file>] <mode>:<device>...");
+	puts("");
+	puts("       inputattach [--daemon] [--baud <baud>] [--noinit]");
+	puts("                   --capture <file> [--rotate <MB>] <mode> <device>");
+	puts("");
+	puts("The second form attaches several ports from one process.  Each line of");
+	puts("the config file is \"<mode> <device> [<baud>]\".");
+	puts("");
+	puts("The third form initializes the device, then records what it sends to");
+	puts("<file> with timestamps instead of attaching it, until interrupted.");
+	puts("--rotate starts <file>.1, <file>.2 and so on every <MB> megabytes.");
 	puts("");
 	puts("Modes:");
 
@@ -650,23 +781,557 @@ static void show_help(void)
 /* palmed wisdom from http://stackoverflow.com/questions/1674162/ */
 #define RETRY_ERROR(x) (x == EAGAIN || x == EWOULDBLOCK || x == EINTR)
 
-int main(int argc, char **argv)
+struct port {
+	struct input_types *type;
+	const char *device;
+	int baud;		/* -1 for the mode's default, or BAUD_UNSET */
+	int fd;			/* -1 unless attached */
+	int one_read;
+	int index;
+	int wake;		/* port_thread() reports here */
+	pthread_t thread;
+	long long retry_at;	/* ms; 0 while port_thread() runs, -1 if dropped */
+	int delay;		/* current re-attach back-off, ms */
+};
+
+/* Not given for the port; --baud applies. */
+#define BAUD_UNSET	-2
+
+static int no_init;
+static int ignore_init_res;
+
+/* Accepts "--mode", "-mode" and "mode". */
+static struct input_types *find_type(const char *name)
+{
+	struct input_types *type;
+
+	for (type = input_types; type->name; type++)
+		if (!strcasecmp(name, type->name) ||
+		    !strcasecmp(name, type->name2) ||
+		    !strcasecmp(name, type->name + 2))
+			return type;
+	return NULL;
+}
+
+/* Open the port and initialize the device. */
+static int open_port(struct port *p, unsigned long *id, unsigned long *extra)
+{
+	int speed = p->type->speed;
+	unsigned char c;
+
+	p->one_read = 0;
+	p->fd = open(p->device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (p->fd < 0) {
+		fprintf(stderr, "inputattach: '%s' - %s\n",
+			p->device, strerror(errno));
+		return -1;
+	}
+
+	if (p->baud != -1 && baud_to_speed(p->baud) != B0)
+		speed = baud_to_speed(p->baud);
+
+	setline(p->fd, p->type->flags, speed);
+	if (p->baud != -1 && baud_to_speed(p->baud) == B0 &&
+	    setline_custom_baud(p->fd, p->baud) < 0) {
+		fprintf(stderr, "inputattach: '%s' - can't set baud rate '%d' - %s\n",
+			p->device, p->baud, strerror(errno));
+		goto fail;
+	}
+
+	if (p->type->flush)
+		while (!readchar(p->fd, &c, 100))
+			/* empty */;
+
+	*id = p->type->id;
+	*extra = p->type->extra;
+
+	if (p->type->init && !no_init) {
+		if (p->type->init(p->fd, id, extra)) {
+			if (ignore_init_res) {
+				fprintf(stderr, "inputattach: '%s' - ignored device initialization failure\n",
+					p->device);
+			} else {
+				fprintf(stderr, "inputattach: '%s' - device initialization failed\n",
+					p->device);
+				goto fail;
+			}
+		}
+	}
+
+	return 0;
+
+fail:
+	close(p->fd);
+	p->fd = -1;
+	return -1;
+}
+
+/* Open the port, initialize the device and hand it to serport. */
+static int attach_port(struct port *p)
 {
-	unsigned long devt;
+	unsigned long devt, id, extra;
 	int ldisc;
-	struct input_types *type = NULL;
+
+	if (open_port(p, &id, &extra))
+		return -1;
+
+	ldisc = N_MOUSE;
+	if (ioctl(p->fd, TIOCSETD, &ldisc) < 0) {
+		fprintf(stderr, "inputattach: '%s' - can't set line discipline\n",
+			p->device);
+		goto fail;
+	}
+
+	devt = p->type->type | (id << 8) | (extra << 16);
+
+	if (ioctl(p->fd, SPIOCSTYPE, &devt) < 0) {
+		fprintf(stderr, "inputattach: '%s' - can't set device type\n",
+			p->device);
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	close(p->fd);
+	p->fd = -1;
+	return -1;
+}
+
+/* Size of the stdio buffer behind a capture file. */
+#define CAPTURE_BUFFER	(1 << 20)
+
+static volatile sig_atomic_t capture_stop;
+
+static void capture_signal(int sig)
+{
+	capture_stop = 1;
+}
+
+static unsigned long long timespec_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/* The rate the line was left at, or 0 if it isn't one we know. */
+static int line_baud(struct port *p)
+{
+	static const int rates[] = {
+		1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400
+	};
+	struct termios t;
+	int i;
+
+	if (tcgetattr(p->fd, &t))
+		return 0;
+	for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+		if (baud_to_speed(rates[i]) == cfgetospeed(&t))
+			return rates[i];
+	return p->baud > 0 ? p->baud : 0;
+}
+
+/* Begin the n'th file of a capture: the path itself, then path.1,
+ * path.2 and so on.  The caller times its chunks from when it called
+ * this. */
+static FILE *capture_open(int n, int baud)
+{
+	struct capture_header h;
+	struct timespec now;
+	char path[4096];
+	FILE *f;
+
+	if (n)
+		snprintf(path, sizeof(path), "%s.%d", capture_path, n);
+	else
+		snprintf(path, sizeof(path), "%s", capture_path);
+	f = fopen(path, "wb");
+	if (!f) {
+		fprintf(stderr, "inputattach: '%s' - %s\n", path,
+			strerror(errno));
+		return NULL;
+	}
+	setvbuf(f, NULL, _IOFBF, CAPTURE_BUFFER);
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN);
+	h.version = CAPTURE_VERSION;
+	h.baud = baud;
+	clock_gettime(CLOCK_REALTIME, &now);
+	h.start = timespec_ns(&now);
+	if (fwrite(&h, sizeof(h), 1, f) != 1) {
+		fprintf(stderr, "inputattach: '%s' - %s\n", path,
+			strerror(errno));
+		fclose(f);
+		return NULL;
+	}
+	return f;
+}
+
+/*
+ * Record what the device sends, as timestamped chunks of whatever each
+ * read() returns, until the line hangs up or we're told to stop.  With
+ * a rotate size, a new file is begun whenever the current one would
+ * grow past it.
+ */
+static int capture_port(struct port *p, long rotate)
+{
+	unsigned char buf[4096], head[2 * CAPTURE_VARINT_MAX];
+	struct sigaction sa;
+	struct timespec start, now;
+	unsigned long long total = 0, last = 0, us;
+	long size = sizeof(struct capture_header);
+	int baud = line_baud(p);
+	int file = 0, err = 0, len;
+	ssize_t n;
+	FILE *f;
+
+	/* No SA_RESTART, so the signal gets us out of read(). */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = capture_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	fcntl(p->fd, F_SETFL, fcntl(p->fd, F_GETFL) & ~O_NONBLOCK);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	f = capture_open(file, baud);
+	if (!f)
+		return -1;
+
+	while (!capture_stop) {
+		n = read(p->fd, buf, sizeof(buf));
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			if (n < 0)
+				fprintf(stderr, "inputattach: '%s' - %s\n",
+					p->device, strerror(errno));
+			break;
+		}
+
+		if (rotate && size > (long)sizeof(struct capture_header) &&
+		    size + (long)sizeof(head) + n > rotate) {
+			if (fclose(f)) {
+				err = -1;
+				f = NULL;
+				break;
+			}
+			/* The new file's clock starts with this chunk. */
+			start = now;
+			f = capture_open(++file, baud);
+			if (!f) {
+				err = -1;
+				break;
+			}
+			size = sizeof(struct capture_header);
+			last = 0;
+		}
+
+		us = (timespec_ns(&now) - timespec_ns(&start)) / 1000;
+		len = capture_put_varint(head, us - last);
+		len += capture_put_varint(head + len, n);
+		last = us;
+		if (fwrite(head, 1, len, f) != len ||
+		    fwrite(buf, 1, n, f) != n) {
+			err = -1;
+			break;
+		}
+		size += len + n;
+		total += n;
+	}
+
+	if (f && fclose(f))
+		err = -1;
+	if (err)
+		fprintf(stderr, "inputattach: '%s' - capture failed - %s\n",
+			capture_path, strerror(errno));
+	fprintf(stderr, "inputattach: '%s' - captured %llu bytes in %d file%s\n",
+		p->device, total, file + 1, file ? "s" : "");
+	return err;
+}
+
+/*
+ * Wait until the line hangs up.  serport creates the serio port inside
+ * read(), and blocks there until the tty is hung up or closed, or a
+ * signal arrives, whatever O_NONBLOCK says; a hung-up tty then reads
+ * as end of file straight away.  So block in read(), and use poll()
+ * to tell a hangup from a signal, after which read() brings the port
+ * back.  Returns -1 if someone else has the port: another inputattach
+ * reading it, or a different line discipline.
+ */
+static int wait_port(struct port *p)
+{
+	struct pollfd pfd = { .fd = p->fd };
+	int flags, ldisc;
+
+	flags = fcntl(p->fd, F_GETFL);
+	if (flags >= 0)
+		fcntl(p->fd, F_SETFL, flags & ~O_NONBLOCK);
+
+	for (;;) {
+		if (read(p->fd, NULL, 0) == 0)
+			p->one_read = 1;
+		else if (errno == EBUSY)
+			return -1;
+		else if (!RETRY_ERROR(errno))
+			return 0;
+
+		if (poll(&pfd, 1, 0) > 0 &&
+		    (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)))
+			return 0;
+		if (ioctl(p->fd, TIOCGETD, &ldisc) < 0)
+			return 0;
+		if (ldisc != N_MOUSE)
+			return -1;
+	}
+}
+
+static void detach_port(struct port *p)
+{
+	int ldisc = 0;
+
+	if (p->one_read) {
+		// If we've never managed to read, avoid resetting the line
+		// discipline - another inputattach is probably running
+		ioctl(p->fd, TIOCSETD, &ldisc);
+	}
+	close(p->fd);
+	p->fd = -1;
+}
+
+static void *attach_thread(void *arg)
+{
+	attach_port(arg);
+	return NULL;
+}
+
+/* Messages from port threads to the supervisor. */
+enum { PORT_HUNG_UP, PORT_TAKEN, PORT_FAILED };
+
+/* Attach the port if it isn't already, then wait for it to hang up. */
+static void *port_thread(void *arg)
+{
+	struct port *p = arg;
+	int msg[2] = { p->index, PORT_HUNG_UP };
+
+	if (p->fd < 0 && attach_port(p))
+		msg[1] = PORT_FAILED;
+	else if (wait_port(p))
+		msg[1] = PORT_TAKEN;
+	if (write(p->wake, msg, sizeof(msg)) != sizeof(msg))
+		perror("inputattach");
+	return NULL;
+}
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* Back-off between attempts to re-attach a port that hung up. */
+#define REATTACH_MIN_MS		1000
+#define REATTACH_MAX_MS		60000
+
+/*
+ * Attach every port at once, since initialization can take seconds
+ * per device, then supervise them all from one epoll loop.  serport
+ * gives no poll() events, and its port only exists while a read() on
+ * the tty is blocked, so each port keeps one thread sitting in read();
+ * the thread reports back through a pipe when its line hangs up.
+ *
+ * A port that hangs up (a USB adapter unplugged, say) is opened and
+ * initialized again, with exponential back-off while that fails.
+ * Ports that fail to attach at startup, or that someone else takes
+ * over, are dropped.
+ */
+static int run_ports(struct port *ports, int nports, int daemon_mode)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	int wake[2], epfd, live = 0, timeout, msg[2], i, n;
+	long long now;
+	struct port *p;
+
+	for (i = 0; i < nports; i++)
+		if (pthread_create(&ports[i].thread, NULL, attach_thread,
+				   &ports[i])) {
+			fprintf(stderr, "inputattach: can't create thread\n");
+			return EXIT_FAILURE;
+		}
+	for (i = 0; i < nports; i++) {
+		pthread_join(ports[i].thread, NULL);
+		if (ports[i].fd >= 0)
+			live++;
+	}
+	if (!live)
+		return EXIT_FAILURE;
+
+	if (daemon_mode && daemon(0, 0) < 0) {
+		perror("inputattach");
+		return EXIT_FAILURE;
+	}
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0 || pipe(wake) < 0 ||
+	    epoll_ctl(epfd, EPOLL_CTL_ADD, wake[0], &ev) < 0) {
+		perror("inputattach");
+		return EXIT_FAILURE;
+	}
+
+	/* Attached ports start waiting now; retry_at 0 means a thread
+	 * is running for the port. */
+	for (i = 0; i < nports; i++) {
+		ports[i].index = i;
+		ports[i].wake = wake[1];
+		ports[i].retry_at = ports[i].fd >= 0 ? now_ms() : -1;
+	}
+
+	while (live) {
+		now = now_ms();
+		timeout = -1;
+		for (i = 0; i < nports; i++) {
+			p = &ports[i];
+			if (p->retry_at <= 0)
+				continue;
+			if (p->retry_at <= now) {
+				p->retry_at = 0;
+				if (pthread_create(&p->thread, NULL,
+						   port_thread, p)) {
+					p->delay = REATTACH_MAX_MS;
+					p->retry_at = now + p->delay;
+				}
+				continue;
+			}
+			if (timeout < 0 || p->retry_at - now < timeout)
+				timeout = p->retry_at - now;
+		}
+
+		n = epoll_wait(epfd, &ev, 1, timeout);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			perror("inputattach");
+			return EXIT_FAILURE;
+		}
+		if (!n || read(wake[0], msg, sizeof(msg)) != sizeof(msg))
+			continue;
+
+		p = &ports[msg[0]];
+		pthread_join(p->thread, NULL);
+		switch (msg[1]) {
+		case PORT_HUNG_UP:
+			detach_port(p);
+			fprintf(stderr, "inputattach: '%s' - hung up, "
+				"re-attaching\n", p->device);
+			p->delay = REATTACH_MIN_MS;
+			p->retry_at = now_ms() + p->delay;
+			break;
+		case PORT_FAILED:
+			p->delay *= 2;
+			if (p->delay > REATTACH_MAX_MS)
+				p->delay = REATTACH_MAX_MS;
+			p->retry_at = now_ms() + p->delay;
+			break;
+		case PORT_TAKEN:
+			p->one_read = 0;
+			detach_port(p);
+			fprintf(stderr, "inputattach: '%s' - taken over, "
+				"giving up\n", p->device);
+			p->retry_at = -1;
+			live--;
+			break;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static struct port *add_port(struct port **ports, int *nports,
+			     struct input_types *type, const char *device,
+			     int baud)
+{
+	struct port *p;
+
+	p = realloc(*ports, (*nports + 1) * sizeof(**ports));
+	if (!p) {
+		perror("inputattach");
+		exit(EXIT_FAILURE);
+	}
+	*ports = p;
+	p += (*nports)++;
+	memset(p, 0, sizeof(*p));
+	p->type = type;
+	p->device = strdup(device);
+	p->baud = baud;
+	p->fd = -1;
+	return p;
+}
+
+/* "<mode> <device> [<baud>]" per line; '#' starts a comment. */
+static int read_config(const char *path, struct port **ports, int *nports)
+{
+	char line[512], mode[64], device[256];
+	struct input_types *type;
+	int n = 0, baud, fields;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "inputattach: '%s' - %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		if (strchr(line, '#'))
+			*strchr(line, '#') = 0;
+		baud = BAUD_UNSET;
+		fields = sscanf(line, "%63s %255s %d", mode, device, &baud);
+		if (fields == EOF || fields == 0)
+			continue;
+		if (fields == 1) {
+			fprintf(stderr, "inputattach: %s:%d - must specify device\n",
+				path, n);
+			goto fail;
+		}
+		type = find_type(mode);
+		if (!type) {
+			fprintf(stderr, "inputattach: %s:%d - invalid mode '%s'\n",
+				path, n, mode);
+			goto fail;
+		}
+		if (fields == 3 && baud <= 0) {
+			fprintf(stderr, "inputattach: %s:%d - invalid baud rate '%d'\n",
+				path, n, baud);
+			goto fail;
+		}
+		add_port(ports, nports, type, device, baud);
+	}
+
+	fclose(f);
+	return 0;
+
+fail:
+	fclose(f);
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	struct input_types *type = NULL, *port_type;
 	const char *device = NULL;
+	struct port *ports = NULL;
+	int nports = 0;
+	unsigned long id, extra;
 	int daemon_mode = 0;
 	int need_device = 0;
-	unsigned long id, extra;
-	int fd;
 	int i;
-	unsigned char c;
-	int retval;
 	int baud = -1;
-	int ignore_init_res = 0;
-	int no_init = 0;
-	int one_read = 0;
+	long rotate = 0;
+	char *colon;
 
 	for (i = 1; i < argc; i++) {
 		if (!strcasecmp(argv[i], "--help")) {
@@ -690,6 +1355,51 @@ int main(int argc, char **argv)
 			}
 
 			baud = atoi(argv[++i]);
+		} else if (!strcasecmp(argv[i], "--capture")) {
+			if (argc <= i + 1) {
+				show_help();
+				fprintf(stderr,
+					"inputattach: require capture file\n");
+				return EXIT_FAILURE;
+			}
+
+			capture_path = argv[++i];
+		} else if (!strcasecmp(argv[i], "--rotate")) {
+			if (argc <= i + 1) {
+				show_help();
+				fprintf(stderr,
+					"inputattach: require file size\n");
+				return EXIT_FAILURE;
+			}
+
+			rotate = atol(argv[++i]) * 1024 * 1024;
+			if (rotate <= 0) {
+				fprintf(stderr,
+					"inputattach: invalid file size '%s'\n",
+					argv[i]);
+				return EXIT_FAILURE;
+			}
+		} else if (!strcasecmp(argv[i], "--config")) {
+			if (argc <= i + 1) {
+				show_help();
+				fprintf(stderr,
+					"inputattach: require config file\n");
+				return EXIT_FAILURE;
+			}
+
+			if (read_config(argv[++i], &ports, &nports))
+				return EXIT_FAILURE;
+		} else if ((colon = strchr(argv[i], ':'))) {
+			*colon = 0;
+			port_type = find_type(argv[i]);
+			if (!port_type) {
+				fprintf(stderr,
+					"inputattach: invalid mode '%s'\n",
+					argv[i]);
+				return EXIT_FAILURE;
+			}
+			add_port(&ports, &nports, port_type, colon + 1,
+				 BAUD_UNSET);
 		} else {
 			if (type && type->name) {
 				fprintf(stderr,
@@ -713,92 +1423,50 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (!type || !type->name) {
-		fprintf(stderr, "inputattach: must specify mode\n");
-		return EXIT_FAILURE;
-        }
-
-	if (need_device) {
-		fprintf(stderr, "inputattach: must specify device\n");
-		return EXIT_FAILURE;
-	}
-
-	fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
-	if (fd < 0) {
-		fprintf(stderr, "inputattach: '%s' - %s\n",
-			device, strerror(errno));
-		return 1;
-	}
-
-	switch(baud) {
-	case -1: break;
-	case 2400: type->speed = B2400; break;
-	case 4800: type->speed = B4800; break;
-	case 9600: type->speed = B9600; break;
-	case 19200: type->speed = B19200; break;
-	case 38400: type->speed = B38400; break;
-	default:
+	if (baud == 0 || baud < -1) {
 		fprintf(stderr, "inputattach: invalid baud rate '%d'\n",
 				baud);
 		return EXIT_FAILURE;
 	}
 
-	setline(fd, type->flags, type->speed);
-
-	if (type->flush)
-		while (!readchar(fd, &c, 100))
-			/* empty */;
-
-	id = type->id;
-	extra = type->extra;
-
-	if (type->init && !no_init) {
-		if (type->init(fd, &id, &extra)) {
-			if (ignore_init_res) {
-				fprintf(stderr, "inputattach: ignored device initialization failure\n");
-			} else {
-				fprintf(stderr, "inputattach: device initialization failed\n");
-				return EXIT_FAILURE;
-			}
+	if (nports) {
+		if (capture_path) {
+			fprintf(stderr, "inputattach: --capture takes a single "
+				"<mode> <device>\n");
+			return EXIT_FAILURE;
 		}
+		if (type) {
+			fprintf(stderr, "inputattach: can't mix <mode> <device> "
+				"with <mode>:<device>\n");
+			return EXIT_FAILURE;
+		}
+		/* --baud applies to ports without a rate of their own. */
+		for (i = 0; i < nports; i++)
+			if (ports[i].baud == BAUD_UNSET)
+				ports[i].baud = baud;
+		return run_ports(ports, nports, daemon_mode);
 	}
 
-	ldisc = N_MOUSE;
-	if (ioctl(fd, TIOCSETD, &ldisc) < 0) {
-		fprintf(stderr, "inputattach: can't set line discipline\n");
+	if (!type || !type->name) {
+		fprintf(stderr, "inputattach: must specify mode\n");
 		return EXIT_FAILURE;
-	}
-
-	devt = type->type | (id << 8) | (extra << 16);
+        }
 
-	if (ioctl(fd, SPIOCSTYPE, &devt) < 0) {
-		fprintf(stderr, "inputattach: can't set device type\n");
+	if (need_device) {
+		fprintf(stderr, "inputattach: must specify device\n");
 		return EXIT_FAILURE;
 	}
 
-	retval = EXIT_SUCCESS;
-	if (daemon_mode && daemon(0, 0) < 0) {
-		perror("inputattach");
-		retval = EXIT_FAILURE;
-	}
-
-	do {
-		i = read(fd, NULL, 0);
-		if (i == -1) {
-			if (RETRY_ERROR(errno))
-				continue;
-		} else {
-			one_read = 1;
+	add_port(&ports, &nports, type, device, baud);
+	if (capture_path) {
+		if (open_port(&ports[0], &id, &extra))
+			return EXIT_FAILURE;
+		if (daemon_mode && daemon(1, 0) < 0) {
+			perror("inputattach");
+			return EXIT_FAILURE;
 		}
-	} while (!i);
-
-	ldisc = 0;
-	if (one_read) {
-		// If we've never managed to read, avoid resetting the line
-		// discipline - another inputattach is probably running
-		ioctl(fd, TIOCSETD, &ldisc);
+		return capture_port(&ports[0], rotate) ? EXIT_FAILURE :
+			EXIT_SUCCESS;
 	}
-	close(fd);
-
-	return retval;
+	return run_ports(ports, nports, daemon_mode);
 }
@@ -0,0 +1,39 @@
+/*
+ * Setting line speeds that have no Bxxx constant
+ *
+ * This needs BOTHER and the kernel's own struct termios, whose header
+ * clashes with <termios.h>, so it lives apart from inputattach.c.
+ * Most architectures have struct termios2 and TCGETS2/TCSETS2 for
+ * this; powerpc has neither, but its struct termios carries the
+ * speeds itself.
+ */
+
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+#include "termios2.h"
+
+int setline_custom_baud(int fd, int baud)
+{
+#ifdef TCGETS2
+	struct termios2 t;
+
+	if (ioctl(fd, TCGETS2, &t) < 0)
+		return -1;
+#else
+	struct termios t;
+
+	if (ioctl(fd, TCGETS, &t) < 0)
+		return -1;
+#endif
+
+	t.c_cflag &= ~CBAUD;
+	t.c_cflag |= BOTHER;
+	t.c_ispeed = t.c_ospeed = baud;
+
+#ifdef TCSETS2
+	return ioctl(fd, TCSETS2, &t);
+#else
+	return ioctl(fd, TCSETS, &t);
+#endif
+}
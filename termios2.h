@@ -0,0 +1,8 @@
+#ifndef TERMIOS2_H
+#define TERMIOS2_H
+
+/* Set the line to any speed the UART can do, through BOTHER.  Returns
+ * -1 with errno set if it can't. */
+int setline_custom_baud(int fd, int baud);
+
+#endif
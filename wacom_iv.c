@@ -0,0 +1,215 @@
+/*
+ * Wacom protocol 4 stream framing and packet decoding
+ *
+ * See wacom_iv.h.  Everything here runs once per received byte or
+ * packet, so keep it free of allocation, locking and logging; callers
+ * decide what to do with the results.
+ */
+
+#ifdef __KERNEL__
+#include <linux/stddef.h>
+#else
+#include <stddef.h>
+#endif
+
+#include "wacom_iv.h"
+
+void wacom_iv_parser_reset(struct wacom_iv_parser *p)
+{
+	p->idx = p->len = p->discarded = p->restart = p->hunting = 0;
+	p->dropped_bytes = p->discarded_packets = p->resyncs = 0;
+}
+
+/* A '~' arrived while a response was being accumulated: that response
+ * is over, and the '~' begins the next one. */
+static void wacom_iv_restart(struct wacom_iv_parser *p)
+{
+	p->restart = 0;
+	p->data[0] = '~';
+	p->idx = 1;
+}
+
+/* Throw away an unfinished packet or response. */
+static void wacom_iv_discard(struct wacom_iv_parser *p)
+{
+	if (!p->idx)
+		return;
+	p->dropped_bytes += p->idx;
+	if (p->data[0] & 0x80)
+		p->discarded_packets++;
+	p->idx = 0;
+}
+
+/*
+ * We're either expecting a carriage return-terminated ASCII response
+ * string starting with '~', or a seven-byte packet with the MSB set on
+ * the first byte and clear on the rest.  Anything else is line noise:
+ * it is dropped, and we resynchronize on the next byte that can start
+ * a packet or a response, rather than waiting for the buffer to fill.
+ *
+ * Note however that some tablets (the PenPartner, for example) don't
+ * send a carriage return at the end of a command.  Callers handle
+ * these by waiting for timeout and calling wacom_iv_parser_flush().
+ *
+ * error is set for bytes the UART flagged with a parity or framing
+ * error; such a byte spoils whatever it was part of.
+ */
+int wacom_iv_parse_byte(struct wacom_iv_parser *p, unsigned char c,
+			int error)
+{
+	int ret;
+
+	if (p->restart)
+		wacom_iv_restart(p);
+
+	if (error) {
+		wacom_iv_discard(p);
+		p->dropped_bytes++;
+		p->hunting = 1;
+		return WACOM_IV_NEED_MORE;
+	}
+
+	if (c & 0x80) {
+		/* Anything unfinished was cut short by this packet. */
+		if (p->idx || p->hunting) {
+			wacom_iv_discard(p);
+			p->resyncs++;
+			p->hunting = 0;
+		}
+		p->data[p->idx++] = c;
+		return WACOM_IV_NEED_MORE;
+	}
+
+	if (!p->idx) {
+		if (c != '~') {
+			p->dropped_bytes++;
+			p->hunting = 1;
+			return WACOM_IV_NEED_MORE;
+		}
+		if (p->hunting) {
+			p->resyncs++;
+			p->hunting = 0;
+		}
+		p->data[p->idx++] = c;
+		return WACOM_IV_NEED_MORE;
+	}
+
+	if (p->data[0] & 0x80) {
+		p->data[p->idx++] = c;
+		if (p->idx < WACOM_IV_PACKET_LENGTH)
+			return WACOM_IV_NEED_MORE;
+		p->len = p->idx;
+		p->idx = 0;
+		return WACOM_IV_PACKET;
+	}
+
+	/* Responses to pipelined requests may follow each other with
+	 * no carriage return in between, but each one starts with a
+	 * '~'. */
+	if (c == '~') {
+		ret = wacom_iv_parser_flush(p);
+		p->restart = 1;
+		return ret;
+	}
+	if (p->idx >= WACOM_IV_BUFFER_SIZE) {
+		p->discarded = p->idx;
+		wacom_iv_discard(p);
+		p->dropped_bytes++;
+		p->hunting = 1;
+		return WACOM_IV_OVERFLOW;
+	}
+
+	p->data[p->idx++] = c;
+	if (c != '\r')
+		return WACOM_IV_NEED_MORE;
+	p->len = p->idx - 1;
+	p->data[p->len] = 0;
+	p->idx = 0;
+	return WACOM_IV_RESPONSE;
+}
+
+/* Terminate whatever has been accumulated so far as a response.  A
+ * packet that stopped short is thrown away instead. */
+int wacom_iv_parser_flush(struct wacom_iv_parser *p)
+{
+	if (p->restart)
+		wacom_iv_restart(p);
+	if (p->idx == 0)
+		return WACOM_IV_NEED_MORE;
+	if (p->data[0] != '~') {
+		wacom_iv_discard(p);
+		return WACOM_IV_NEED_MORE;
+	}
+
+	p->len = p->idx;
+	p->data[p->len] = 0;
+	p->idx = 0;
+	return WACOM_IV_RESPONSE;
+}
+
+/* Indexed by the stylus bit (data[0] & 0x20) and the eraser button
+ * (data[3] & 0x20, button & 4).
+ *
+ * NOTE: According to old wcmSerial code, button&8 is the eraser on
+ * Graphire tablets.  I have removed this until someone can verify
+ * it. */
+static const unsigned char wacom_iv_tools[4] = {
+	WACOM_IV_CURSOR, WACOM_IV_CURSOR, WACOM_IV_STYLUS, WACOM_IV_ERASER
+};
+
+/* extra_z_bits is a constant in every caller, so each of these is
+ * compiled into straight-line code for one pressure layout. */
+static inline void wacom_iv_decode(const unsigned char *data,
+				   const int extra_z_bits,
+				   struct wacom_iv_packet *pkt)
+{
+	int z;
+
+	pkt->in_proximity = data[0] & 0x40;
+	pkt->button = (data[3] & 0x78) >> 3;
+	pkt->x = (data[0] & 3) << 14 | data[1]<<7 | data[2];
+	pkt->y = (data[3] & 3) << 14 | data[4]<<7 | data[5];
+	z = data[6] & 0x7f;
+	if (extra_z_bits >= 1)
+		z = z << 1 | (data[3] & 0x4) >> 2;
+	if (extra_z_bits > 1)
+		z = z << 1 | (data[0] & 0x4) >> 2;
+	pkt->z = z ^ (0x40 << extra_z_bits);
+	pkt->tool = wacom_iv_tools[(data[0] & 0x20) >> 4 |
+				   (data[3] & 0x20) >> 5];
+}
+
+#define WACOM_IV_DECODER(n)						\
+static void wacom_iv_decode_z##n(const unsigned char *data,		\
+				 struct wacom_iv_packet *pkt)		\
+{									\
+	wacom_iv_decode(data, n, pkt);					\
+}									\
+									\
+static void wacom_iv_decode_batch_z##n(const unsigned char *data,	\
+				       int count,			\
+				       struct wacom_iv_packet *pkts)	\
+{									\
+	int i;								\
+									\
+	for (i = 0; i < count; i++)					\
+		wacom_iv_decode(data + i * WACOM_IV_PACKET_LENGTH, n,	\
+				&pkts[i]);				\
+}
+
+WACOM_IV_DECODER(0)
+WACOM_IV_DECODER(1)
+WACOM_IV_DECODER(2)
+
+static const struct wacom_iv_decoder wacom_iv_decoders[] = {
+	{ wacom_iv_decode_z0, wacom_iv_decode_batch_z0 },
+	{ wacom_iv_decode_z1, wacom_iv_decode_batch_z1 },
+	{ wacom_iv_decode_z2, wacom_iv_decode_batch_z2 },
+};
+
+const struct wacom_iv_decoder *wacom_iv_get_decoder(int extra_z_bits)
+{
+	if (extra_z_bits < 0 || extra_z_bits > WACOM_IV_MAX_EXTRA_Z_BITS)
+		return NULL;
+	return &wacom_iv_decoders[extra_z_bits];
+}
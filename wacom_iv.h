@@ -0,0 +1,71 @@
+/*
+ * Wacom protocol 4 stream framing and packet decoding
+ *
+ * This is shared between the wacom_serial kernel module and the
+ * userspace tools built by the Makefile (libwacom_iv.a, the decode
+ * benchmark), so it must not depend on anything kernel-specific.
+ */
+
+#ifndef WACOM_IV_H
+#define WACOM_IV_H
+
+/* Note that this is a protocol 4 packet without tilt information. */
+#define WACOM_IV_PACKET_LENGTH	7
+#define WACOM_IV_BUFFER_SIZE	32
+#define WACOM_IV_MAX_EXTRA_Z_BITS	2
+
+enum {
+	WACOM_IV_STYLUS = 1,
+	WACOM_IV_ERASER,
+	WACOM_IV_PAD,
+	WACOM_IV_CURSOR,
+	WACOM_IV_TOUCH
+};
+
+/* Return values of wacom_iv_parse_byte() and wacom_iv_parser_flush(). */
+enum {
+	WACOM_IV_NEED_MORE = 0,
+	WACOM_IV_PACKET,	/* data[] holds a complete packet */
+	WACOM_IV_RESPONSE,	/* data[] holds a NUL-terminated response */
+	WACOM_IV_OVERFLOW	/* a response too long for data[] was dropped */
+};
+
+struct wacom_iv_parser {
+	unsigned char data[WACOM_IV_BUFFER_SIZE + 1];
+	int idx;		/* bytes accumulated so far */
+	int len;		/* length of the last packet or response */
+	int discarded;		/* length of the last overflowing response */
+	int restart;		/* next response began before this one ended */
+	int hunting;		/* waiting for a byte that can start a frame */
+	/* Line noise statistics */
+	unsigned long dropped_bytes;
+	unsigned long discarded_packets;	/* cut short or damaged */
+	unsigned long resyncs;
+};
+
+struct wacom_iv_packet {
+	int in_proximity, tool, button;
+	int x, y, z;
+};
+
+/*
+ * Packet decoders, one per pressure layout (extra_z_bits).  Pick one
+ * with wacom_iv_get_decoder() once the model is known, rather than
+ * passing extra_z_bits with every packet.  decode_batch() decodes
+ * count packets laid out back to back in data.
+ */
+struct wacom_iv_decoder {
+	void (*decode)(const unsigned char *data,
+		       struct wacom_iv_packet *pkt);
+	void (*decode_batch)(const unsigned char *data, int count,
+			     struct wacom_iv_packet *pkts);
+};
+
+void wacom_iv_parser_reset(struct wacom_iv_parser *p);
+int wacom_iv_parse_byte(struct wacom_iv_parser *p, unsigned char c,
+			int error);
+int wacom_iv_parser_flush(struct wacom_iv_parser *p);
+/* Returns NULL if extra_z_bits is out of range. */
+const struct wacom_iv_decoder *wacom_iv_get_decoder(int extra_z_bits);
+
+#endif
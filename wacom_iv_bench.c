@@ -0,0 +1,227 @@
+/*
+ * Decode benchmark for the protocol 4 framing and decoding code
+ *
+ * Replays byte streams through wacom_iv_parse_byte() and the packet
+ * decoder exactly as the driver does, once for each extra_z_bits
+ * variant, and reports packets/s and ns/packet.  Then the same packets,
+ * already framed, go through the batch decoder alone.
+ *
+ * Usage: wacom_iv_bench [-n <packets>] [-r <repeats>] [capture...]
+ *
+ * Without captures only the synthetic stream is used.  Captures are
+ * either raw byte dumps of a tablet's serial output or timestamped
+ * ones from inputattach --capture (see capture.h); the times are
+ * ignored here.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "wacom_iv.h"
+
+struct stream {
+	const char *name;
+	unsigned char *buf;
+	size_t len;
+	/* The packets found in buf, back to back */
+	unsigned char *packets;
+	unsigned long npackets;
+};
+
+/* Packets per decode_batch() call */
+#define BATCH	64
+
+static volatile unsigned long sink;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Pen motion with occasional button, eraser and proximity changes. */
+static void make_synthetic(struct stream *s, unsigned long packets)
+{
+	unsigned long i;
+	unsigned char *p;
+	int x = 1000, y = 1000, z = 0;
+
+	s->name = "synthetic";
+	s->len = packets * WACOM_IV_PACKET_LENGTH;
+	s->buf = p = malloc(s->len);
+	if (!p) {
+		perror("wacom_iv_bench");
+		exit(EXIT_FAILURE);
+	}
+
+	srand(1);
+	for (i = 0; i < packets; i++) {
+		int r = rand();
+		int button = (r >> 8) & 0xf;
+		int prox = (r & 0xff) != 0;
+
+		x = (x + (r & 0x1f) - 15) & 0xffff;
+		y = (y + ((r >> 5) & 0x1f) - 15) & 0xffff;
+		z = (z + ((r >> 12) & 7)) & 0x1ff;
+
+		p[0] = 0x80 | (prox ? 0x40 : 0) | 0x20 | (z & 1) << 2 | (x >> 14);
+		p[1] = (x >> 7) & 0x7f;
+		p[2] = x & 0x7f;
+		p[3] = button << 3 | (z & 2) << 1 | (y >> 14);
+		p[4] = (y >> 7) & 0x7f;
+		p[5] = y & 0x7f;
+		p[6] = (z >> 2) & 0x7f;
+		p += WACOM_IV_PACKET_LENGTH;
+	}
+}
+
+static int load_capture(struct stream *s, const char *path)
+{
+	struct capture c;
+
+	if (capture_load(&c, path))
+		return -1;
+	s->name = path;
+	s->buf = c.data;
+	s->len = c.len;
+	free(c.chunks);
+	return 0;
+}
+
+static int frame(struct stream *s)
+{
+	struct wacom_iv_parser parser;
+	size_t i;
+
+	s->packets = malloc(s->len ? s->len : 1);
+	if (!s->packets)
+		return -1;
+	s->npackets = 0;
+	wacom_iv_parser_reset(&parser);
+	for (i = 0; i < s->len; i++)
+		if (wacom_iv_parse_byte(&parser, s->buf[i], 0) == WACOM_IV_PACKET)
+			memcpy(s->packets + s->npackets++ * WACOM_IV_PACKET_LENGTH,
+			       parser.data, WACOM_IV_PACKET_LENGTH);
+	return 0;
+}
+
+static unsigned long replay(const struct stream *s,
+			    const struct wacom_iv_decoder *decoder)
+{
+	struct wacom_iv_parser parser;
+	struct wacom_iv_packet pkt;
+	unsigned long packets = 0;
+	size_t i;
+
+	wacom_iv_parser_reset(&parser);
+	for (i = 0; i < s->len; i++) {
+		if (wacom_iv_parse_byte(&parser, s->buf[i], 0) != WACOM_IV_PACKET)
+			continue;
+		decoder->decode(parser.data, &pkt);
+		sink += pkt.x ^ pkt.y ^ pkt.z ^ pkt.tool ^ pkt.button;
+		packets++;
+	}
+	return packets;
+}
+
+static unsigned long replay_batch(const struct stream *s,
+				  const struct wacom_iv_decoder *decoder)
+{
+	struct wacom_iv_packet pkts[BATCH];
+	unsigned long i;
+	int j, n;
+
+	for (i = 0; i < s->npackets; i += n) {
+		n = s->npackets - i < BATCH ? s->npackets - i : BATCH;
+		decoder->decode_batch(s->packets + i * WACOM_IV_PACKET_LENGTH,
+				      n, pkts);
+		for (j = 0; j < n; j++)
+			sink += pkts[j].x ^ pkts[j].y ^ pkts[j].z ^
+				pkts[j].tool ^ pkts[j].button;
+	}
+	return s->npackets;
+}
+
+static void bench(const struct stream *s, int repeats)
+{
+	static const struct {
+		const char *name;
+		unsigned long (*replay)(const struct stream *s,
+					const struct wacom_iv_decoder *decoder);
+	} modes[] = {
+		{ "", replay },
+		{ " batch", replay_batch },
+	};
+	int m, z, r;
+
+	for (m = 0; m < 2; m++) {
+		for (z = 0; z <= WACOM_IV_MAX_EXTRA_Z_BITS; z++) {
+			const struct wacom_iv_decoder *decoder =
+				wacom_iv_get_decoder(z);
+			unsigned long packets = 0;
+			double t0, dt;
+
+			t0 = now_ns();
+			for (r = 0; r < repeats; r++)
+				packets += modes[m].replay(s, decoder);
+			dt = now_ns() - t0;
+
+			if (!packets) {
+				printf("%-24s z%d%-6s: no packets\n", s->name,
+				       z, modes[m].name);
+				continue;
+			}
+			printf("%-24s z%d%-6s: %10lu packets %14.0f packets/s "
+			       "%8.2f ns/packet\n", s->name, z, modes[m].name,
+			       packets, packets / (dt / 1e9), dt / packets);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct stream s;
+	unsigned long packets = 1000000;
+	int repeats = 10;
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			packets = strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			repeats = atoi(argv[++i]);
+		else {
+			fprintf(stderr, "Usage: wacom_iv_bench [-n <packets>] "
+				"[-r <repeats>] [capture...]\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	make_synthetic(&s, packets);
+	if (frame(&s)) {
+		perror("wacom_iv_bench");
+		return EXIT_FAILURE;
+	}
+	bench(&s, repeats);
+	free(s.buf);
+	free(s.packets);
+
+	for (; i < argc; i++) {
+		if (load_capture(&s, argv[i]) || frame(&s)) {
+			fprintf(stderr, "wacom_iv_bench: '%s' - %s\n",
+				argv[i], strerror(errno));
+			return EXIT_FAILURE;
+		}
+		bench(&s, repeats);
+		free(s.buf);
+		free(s.packets);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,476 @@
+/*
+ * Wacom protocol 4 tablet emulator
+ *
+ * Opens a pseudo-terminal and behaves like a protocol IV tablet on
+ * the other end of it, so that inputattach --wacom_iv and the
+ * wacom_serial driver can be exercised without hardware:
+ *
+ *   ./wacom_iv_emu -m penpartner -l /tmp/wacom &
+ *   inputattach --wacom_iv /tmp/wacom
+ *
+ * It answers ~#, ~R and ~C the way each model does (including the
+ * PenPartner's missing carriage return, and the Graphire ignoring
+ * ~C), obeys ST, SP, BAxx and the reset sequences, and accepts
+ * the other setup commands.  While started it streams packets at the
+ * requested rate, capped at what the emulated line speed could carry,
+ * either from a script or from a random walk.
+ *
+ * With -S, the emulated tablet only understands what it is sent when
+ * the pty is set to the speed it's expecting, like the real thing.
+ * A pty has no real line, so this is judged when the bytes are read:
+ * a command written just before a speed change may be judged at the
+ * new speed and ignored, much as a real tablet can miss a command
+ * while it switches.  Without -S the tablet follows whatever speed
+ * the line is set to.
+ *
+ * Script lines are "<x> <y> <pressure> <buttons> <tool> <prox>",
+ * where <tool> is pen, eraser or puck; the script is replayed in a
+ * loop.
+ *
+ * With -T it instead checks that every model's packets decode back to
+ * what was encoded with the decoder the driver uses, and exits; make
+ * check runs that.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wacom_iv.h"
+
+struct model {
+	const char *name;
+	const char *model;	/* answer to ~#, with its terminator */
+	const char *config;	/* answer to ~R, or NULL */
+	const char *coords;	/* answer to ~C, or NULL */
+	int extra_z_bits;
+	int max_x, max_y;
+};
+
+/* One per branch of handle_model_response() in wacom_serial_core.c */
+static const struct model models[] = {
+	{ "digitizer2", "~#UD-1212-R00 V1.3-6\r",
+	  "~RE202C900,002,02,1270,1270\r", "~C15240,15240\r", 1, 15240, 15240 },
+	{ "digitizer2-old", "~#UD-1212-R00 V1.2-1\r",
+	  "~RE202C900,002,02,1270,1270\r", "~C15240,15240\r", 0, 15240, 15240 },
+	{ "penpartner", "~#CT-0405-R00 V1.3-5",
+	  "~RE202C900,002,02,1000,1000\r", "~C5040,3780\r", 1, 5040, 3780 },
+	{ "graphire", "~#ET-0405-R00 V1.1-0\r",
+	  "~RE202C900,002,02,1016,1016\r", NULL, 2, 5103, 3711 },
+	{ "cintiq-pl550", "~#PL-550 V2.0-2\r",
+	  "~RE202C900,002,02,2540,2540\r", "~C10240,7680\r", 2, 10240, 7680 },
+	{ "cintiq-pl710", "~#PL-710 V2.0-2\r",
+	  "~RE202C900,002,02,2540,2540\r", "~C14400,10800\r", 2, 14400, 10800 },
+	{ "cintiq-pl400", "~#PL-400 V1.0-3\r",
+	  "~RE202C900,002,02,2540,2540\r", "~C8200,6150\r", 1, 8200, 6150 },
+	{ "intuos", "~#GD-0608-R00 V1.1-7\r",
+	  "~RE202C900,002,02,2540,2540\r", "~C20320,16240\r", 1, 20320, 16240 },
+	{ "unknown", "~#XX-0000 V1.0-0\r",
+	  "~RE202C900,002,02,1000,1000\r", "~C10000,10000\r", 1, 10000, 10000 },
+	{ NULL }
+};
+
+struct sample {
+	int x, y, z, buttons, tool, prox;
+};
+
+static const struct model *model = models;
+static int fd, slave_fd, verbose, strict;
+static int baud = 9600;
+static int streaming;
+static double rate = 200;	/* packets/s while streaming */
+static struct sample *script;
+static int script_len, script_pos;
+static int multi;		/* alternate pen and puck */
+static unsigned long sent;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int speed_to_baud(speed_t s)
+{
+	switch (s) {
+	case B1200: return 1200;
+	case B2400: return 2400;
+	case B4800: return 4800;
+	case B9600: return 9600;
+	case B19200: return 19200;
+	case B38400: return 38400;
+	case B57600: return 57600;
+	case B115200: return 115200;
+	default: return 0;
+	}
+}
+
+/* The speed the other end has set the line to, or 0. */
+static int line_baud(void)
+{
+	struct termios t;
+
+	if (tcgetattr(slave_fd, &t))
+		return 0;
+	return speed_to_baud(cfgetospeed(&t));
+}
+
+static void send_str(const char *s)
+{
+	size_t len = strlen(s);
+
+	if (write(fd, s, len) != (ssize_t)len)
+		perror("wacom_iv_emu: write");
+}
+
+static void command(const char *cmd)
+{
+	if (verbose)
+		fprintf(stderr, "wacom_iv_emu: command '%s'\n", cmd);
+
+	if (!strcmp(cmd, "~R")) {
+		if (model->config)
+			send_str(model->config);
+	} else if (!strcmp(cmd, "~C")) {
+		if (model->coords)
+			send_str(model->coords);
+	} else if (!strcmp(cmd, "ST")) {
+		streaming = 1;
+	} else if (!strcmp(cmd, "SP")) {
+		streaming = 0;
+	} else if (!strncmp(cmd, "BA", 2)) {
+		if (!strcmp(cmd + 2, "96"))
+			baud = 9600;
+		else if (!strcmp(cmd + 2, "19"))
+			baud = 19200;
+		else if (!strcmp(cmd + 2, "38"))
+			baud = 38400;
+	}
+	/* MU1, OC1, ~M0, ~M1, IT0, IN0, SR, PH1, ZF1 and the like
+	 * change nothing we emulate. */
+}
+
+/* Commands end with a CR, except ~#, and the resets, which are a CR
+ * followed by $ (back to 9600 baud) or # (back to protocol IV). */
+static void receive(unsigned char c)
+{
+	static char buf[64];
+	static int len, after_cr;
+
+	if (after_cr && len == 0 && (c == '$' || c == '#')) {
+		if (verbose)
+			fprintf(stderr, "wacom_iv_emu: reset '%c'\n", c);
+		if (c == '$')
+			baud = 9600;
+		streaming = 0;
+		after_cr = 0;
+		return;
+	}
+	after_cr = 0;
+
+	if (c == '\r') {
+		buf[len] = 0;
+		if (len)
+			command(buf);
+		len = 0;
+		after_cr = 1;
+		return;
+	}
+	if (len == 1 && buf[0] == '~' && c == '#') {
+		if (verbose)
+			fprintf(stderr, "wacom_iv_emu: command '~#'\n");
+		send_str(model->model);
+		len = 0;
+		return;
+	}
+	if (len < sizeof(buf) - 1)
+		buf[len++] = c;
+}
+
+static void encode(unsigned char *p, const struct sample *s)
+{
+	int z = s->z ^ (0x40 << model->extra_z_bits);
+	int button = s->buttons & 3;
+
+	if (s->tool == WACOM_IV_ERASER)
+		button |= 4;
+
+	p[0] = 0x80 | (s->prox ? 0x40 : 0) |
+		(s->tool != WACOM_IV_CURSOR ? 0x20 : 0) | ((s->x >> 14) & 3);
+	p[1] = (s->x >> 7) & 0x7f;
+	p[2] = s->x & 0x7f;
+	p[3] = (button << 3) | ((s->y >> 14) & 3);
+	p[4] = (s->y >> 7) & 0x7f;
+	p[5] = s->y & 0x7f;
+
+	switch (model->extra_z_bits) {
+	case 0:
+		p[6] = z & 0x7f;
+		break;
+	case 1:
+		p[6] = (z >> 1) & 0x7f;
+		p[3] |= (z & 1) << 2;
+		break;
+	default:
+		p[6] = (z >> 2) & 0x7f;
+		p[3] |= ((z >> 1) & 1) << 2;
+		p[0] |= (z & 1) << 2;
+		break;
+	}
+}
+
+/* Round-trip a spread of samples through encode() and the decoder for
+ * each model's pressure layout.  Returns the number of mismatches. */
+static int self_test(void)
+{
+	static const int tools[] = {
+		WACOM_IV_STYLUS, WACOM_IV_ERASER, WACOM_IV_CURSOR
+	};
+	const struct wacom_iv_decoder *d;
+	struct wacom_iv_packet pkt;
+	unsigned char p[WACOM_IV_PACKET_LENGTH];
+	struct sample s;
+	int failures = 0, max_z, t, i;
+
+	for (model = models; model->name; model++) {
+		d = wacom_iv_get_decoder(model->extra_z_bits);
+		max_z = (1 << (7 + model->extra_z_bits)) - 1;
+		for (t = 0; t < 3; t++)
+			for (i = 0; i <= max_z; i++) {
+				s.tool = tools[t];
+				s.prox = i & 1;
+				s.buttons = i & 3;
+				s.x = i * model->max_x / max_z;
+				s.y = model->max_y - i * model->max_y / max_z;
+				s.z = i;
+				encode(p, &s);
+				d->decode(p, &pkt);
+				if (!pkt.in_proximity == !s.prox &&
+				    pkt.tool == s.tool &&
+				    (pkt.button & 3) == s.buttons &&
+				    pkt.x == s.x && pkt.y == s.y &&
+				    pkt.z == s.z)
+					continue;
+				fprintf(stderr, "wacom_iv_emu: %s: sent %d,%d "
+					"z %d buttons %d tool %d, got %d,%d "
+					"z %d buttons %d tool %d\n",
+					model->name, s.x, s.y, s.z, s.buttons,
+					s.tool, pkt.x, pkt.y, pkt.z, pkt.button,
+					pkt.tool);
+				failures++;
+			}
+	}
+	return failures;
+}
+
+static void next_sample(struct sample *s)
+{
+	static struct sample pen = { 1000, 1000, 0, 0, WACOM_IV_STYLUS, 1 };
+	static struct sample puck = { 3000, 3000, 0, 0, WACOM_IV_CURSOR, 1 };
+	static unsigned long n;
+	struct sample *t;
+	int max_z = (1 << (7 + model->extra_z_bits)) - 1;
+
+	if (script_len) {
+		*s = script[script_pos];
+		script_pos = (script_pos + 1) % script_len;
+		return;
+	}
+
+	t = (multi && (n & 1)) ? &puck : &pen;
+	n++;
+	t->x += rand() % 21 - 10;
+	t->y += rand() % 21 - 10;
+	if (t->x < 0) t->x = 0;
+	if (t->y < 0) t->y = 0;
+	if (t->x > model->max_x) t->x = model->max_x;
+	if (t->y > model->max_y) t->y = model->max_y;
+	t->z = (n / 4) % (max_z + 1);
+	t->buttons = (n / 500) % 4 == 3;
+	*s = *t;
+}
+
+static int load_script(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[256], tool[16];
+	struct sample s;
+	int cap = 0;
+
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%d %d %d %d %15s %d", &s.x, &s.y, &s.z,
+			   &s.buttons, tool, &s.prox) != 6)
+			continue;
+		s.tool = !strcmp(tool, "puck") ? WACOM_IV_CURSOR :
+			!strcmp(tool, "eraser") ? WACOM_IV_ERASER :
+			WACOM_IV_STYLUS;
+		if (script_len == cap) {
+			cap = cap ? cap * 2 : 64;
+			script = realloc(script, cap * sizeof(*script));
+			if (!script)
+				return -1;
+		}
+		script[script_len++] = s;
+	}
+	fclose(f);
+	return script_len ? 0 : -1;
+}
+
+static void usage(void)
+{
+	const struct model *m;
+
+	fprintf(stderr,
+		"Usage: wacom_iv_emu [-m <model>] [-r <packets/s>] [-s <script>]\n"
+		"                    [-l <link>] [-M] [-S] [-v]\n"
+		"       wacom_iv_emu -T\n"
+		"  -m  model to emulate (default %s)\n"
+		"  -r  packet rate while streaming (default %g), capped by the line speed\n"
+		"  -s  replay samples from a script instead of a random walk\n"
+		"  -l  symlink to create to the pty\n"
+		"  -M  alternate pen and puck packets, as in multi-mode\n"
+		"  -S  ignore commands sent at the wrong line speed\n"
+		"  -v  log commands to stderr\n"
+		"  -T  check every model's packets decode correctly, and exit\n"
+		"Models:", models[0].name, rate);
+	for (m = models; m->name; m++)
+		fprintf(stderr, " %s", m->name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *link = NULL, *name;
+	double next = 0, t, max_rate, last_report;
+	unsigned long last_sent = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:r:s:l:MSvT")) != -1) {
+		switch (opt) {
+		case 'm':
+			for (model = models; model->name; model++)
+				if (!strcmp(model->name, optarg))
+					break;
+			if (!model->name) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 's':
+			if (load_script(optarg)) {
+				fprintf(stderr, "wacom_iv_emu: can't load "
+					"script '%s'\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'l':
+			link = optarg;
+			break;
+		case 'M':
+			multi = 1;
+			break;
+		case 'S':
+			strict = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'T':
+			if (self_test())
+				return EXIT_FAILURE;
+			printf("wacom_iv_emu: all models decode correctly\n");
+			return EXIT_SUCCESS;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fd < 0 || grantpt(fd) || unlockpt(fd) || !(name = ptsname(fd))) {
+		perror("wacom_iv_emu: pty");
+		return EXIT_FAILURE;
+	}
+	/* Keep the slave open ourselves, so the pty survives
+	 * inputattach coming and going, and so we can see what line
+	 * speed it has set. */
+	slave_fd = open(name, O_RDWR | O_NOCTTY);
+	if (slave_fd < 0) {
+		perror("wacom_iv_emu: pty");
+		return EXIT_FAILURE;
+	}
+	if (link) {
+		unlink(link);
+		if (symlink(name, link)) {
+			perror("wacom_iv_emu: symlink");
+			return EXIT_FAILURE;
+		}
+	}
+	printf("%s\n", name);
+	fflush(stdout);
+
+	last_report = now();
+	for (;;) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		unsigned char buf[64];
+		int timeout = -1, i, n;
+
+		t = now();
+		if (streaming)
+			timeout = next > t ? (int)((next - t) * 1000) : 0;
+		if (poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+			perror("wacom_iv_emu: poll");
+			return EXIT_FAILURE;
+		}
+
+		if (pfd.revents & POLLIN) {
+			n = read(fd, buf, sizeof(buf));
+			if (n < 0 && errno != EAGAIN && errno != EINTR) {
+				perror("wacom_iv_emu: read");
+				return EXIT_FAILURE;
+			}
+			for (i = 0; i < n; i++)
+				if (!strict || line_baud() == baud)
+					receive(buf[i]);
+		}
+
+		/* 10 bits per byte on the wire. */
+		max_rate = (strict || !line_baud() ? baud : line_baud()) /
+			10.0 / WACOM_IV_PACKET_LENGTH;
+		t = now();
+		if (streaming && t >= next) {
+			unsigned char p[WACOM_IV_PACKET_LENGTH];
+			struct sample s;
+
+			next_sample(&s);
+			encode(p, &s);
+			if (write(fd, p, sizeof(p)) == sizeof(p))
+				sent++;
+			next = (next && t - next < 1 ? next : t) +
+				1 / (rate < max_rate ? rate : max_rate);
+		}
+
+		if (verbose && t - last_report >= 1) {
+			fprintf(stderr, "wacom_iv_emu: %.0f packets/s\n",
+				(sent - last_sent) / (t - last_report));
+			last_sent = sent;
+			last_report = t;
+		}
+	}
+}
@@ -0,0 +1,450 @@
+/*
+ * Replay captured protocol 4 streams into the wacom_serial driver
+ *
+ * Creates a serio port through the kernel's userio device (the
+ * "userio" module, /dev/userio), binds wacom_serial to it, answers the
+ * driver's probe, then feeds a capture into wacom_interrupt() and
+ * reads the resulting events back from evdev.  No serial hardware or
+ * inputattach is involved.
+ *
+ * Usage: wacom_iv_replay [-b <baud>] [-f] [-r <repeats>]
+ *                        [-m <model>] [-R <config>] [-C <coords>] capture
+ *
+ * By default the capture is replayed in real time: a capture from
+ * inputattach --capture (see capture.h) with the timing it was
+ * recorded with, and a raw byte dump of a tablet's serial output at
+ * the given line speed (10 bits per byte).  With -f it goes as fast as
+ * userio will take it.  -m, -R and -C give the responses to the
+ * driver's probe.
+ *
+ * userio can only set a port's type, not its protocol, so the port is
+ * a plain SERIO_RS232 one, which wacom_serial only takes while its
+ * userio parameter is set.  It is set for as long as the port takes to
+ * bind, then put back.  Every byte costs a write() to userio, which is
+ * included in the CPU figures.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <linux/input.h>
+#include <linux/serio.h>
+#include <linux/userio.h>
+
+#include "capture.h"
+#include "wacom_iv.h"
+
+#define SERIO_DEVICES	"/sys/bus/serio/devices"
+#define USERIO_NAME	"Userspace serio port"
+#define USERIO_PARAM	"/sys/module/wacom_serial/parameters/userio"
+
+static const char *model = "~#UD-1212-R00 V1.3-6\r";
+static const char *config = "~RE202C900,002,02,1270,1270\r";
+static const char *coords = "~C15240,15240\r";
+
+static int userio_fd, event_fd = -1;
+static char serio[64];
+static unsigned long events, frames;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_self(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+		ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+/* Busy time of all CPUs, in seconds, which includes the driver's work
+ * items and the input core. */
+static double cpu_all(void)
+{
+	unsigned long long v[8] = { 0 };
+	FILE *f = fopen("/proc/stat", "r");
+
+	if (!f)
+		return 0;
+	if (fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+		   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 8)
+		v[0] = v[1] = v[2] = v[4] = v[5] = v[6] = v[7] = 0;
+	fclose(f);
+	/* Everything but idle and iowait. */
+	return (double)(v[0] + v[1] + v[2] + v[5] + v[6] + v[7]) /
+		sysconf(_SC_CLK_TCK);
+}
+
+static int userio_cmd(int type, int data)
+{
+	struct userio_cmd cmd = { .type = type, .data = data };
+
+	return write(userio_fd, &cmd, sizeof(cmd)) == sizeof(cmd) ? 0 : -1;
+}
+
+static int send_bytes(const unsigned char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (userio_cmd(USERIO_CMD_SEND_INTERRUPT, buf[i]))
+			return -1;
+	return 0;
+}
+
+static int read_sysfs(const char *path, char *buf, int size)
+{
+	int fd = open(path, O_RDONLY), n;
+
+	if (fd < 0)
+		return -1;
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n < 0)
+		return -1;
+	buf[n] = 0;
+	if (n && buf[n - 1] == '\n')
+		buf[n - 1] = 0;
+	return 0;
+}
+
+static int write_sysfs(const char *path, const char *s)
+{
+	int fd = open(path, O_WRONLY), n;
+
+	if (fd < 0)
+		return -1;
+	n = write(fd, s, strlen(s));
+	close(fd);
+	return n == (int)strlen(s) ? 0 : -1;
+}
+
+/* Our port is the newest userio port that nothing but wacom_serial
+ * has bound to. */
+static int find_port(void)
+{
+	char path[300], buf[64], link[300], *name;
+	struct dirent *d;
+	ssize_t len;
+	DIR *dir;
+	int best = -1, n;
+
+	dir = opendir(SERIO_DEVICES);
+	if (!dir)
+		return -1;
+	while ((d = readdir(dir))) {
+		if (sscanf(d->d_name, "serio%d", &n) != 1 || n <= best)
+			continue;
+		snprintf(path, sizeof(path), SERIO_DEVICES "/%s/description",
+			 d->d_name);
+		if (read_sysfs(path, buf, sizeof(buf)) ||
+		    strcmp(buf, USERIO_NAME))
+			continue;
+		snprintf(path, sizeof(path), SERIO_DEVICES "/%s/driver",
+			 d->d_name);
+		len = readlink(path, link, sizeof(link) - 1);
+		if (len >= 0) {
+			link[len] = 0;
+			name = strrchr(link, '/');
+			if (strcmp(name ? name + 1 : link, "wacom_serial"))
+				continue;
+		}
+		best = n;
+	}
+	closedir(dir);
+	if (best < 0)
+		return -1;
+	snprintf(serio, sizeof(serio), "serio%d", best);
+	return 0;
+}
+
+/* The event device appears once the driver's probe has finished. */
+static int open_event_device(void)
+{
+	char path[300], input[256];
+	struct dirent *d;
+	DIR *dir;
+
+	snprintf(path, sizeof(path), SERIO_DEVICES "/%s/input", serio);
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+	input[0] = 0;
+	while ((d = readdir(dir)))
+		if (!strncmp(d->d_name, "input", 5))
+			snprintf(input, sizeof(input), "%s", d->d_name);
+	closedir(dir);
+	if (!input[0])
+		return -1;
+
+	snprintf(path, sizeof(path), SERIO_DEVICES "/%s/input/%s", serio,
+		 input);
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+	while ((d = readdir(dir)))
+		if (!strncmp(d->d_name, "event", 5)) {
+			snprintf(path, sizeof(path), "/dev/input/%s",
+				 d->d_name);
+			event_fd = open(path, O_RDONLY | O_NONBLOCK);
+			break;
+		}
+	closedir(dir);
+	return event_fd < 0 ? -1 : 0;
+}
+
+/* Answer whatever the driver has written to the port. */
+static void answer(void)
+{
+	static char cmd[64];
+	static int len;
+	char buf[64];
+	int i, n;
+
+	n = read(userio_fd, buf, sizeof(buf));
+	for (i = 0; i < n; i++) {
+		if (buf[i] == '\r') {
+			cmd[len] = 0;
+			if (!strcmp(cmd, "~R"))
+				send_bytes((const unsigned char *)config,
+					   strlen(config));
+			else if (!strcmp(cmd, "~C"))
+				send_bytes((const unsigned char *)coords,
+					   strlen(coords));
+			len = 0;
+			continue;
+		}
+		if (len == 1 && cmd[0] == '~' && buf[i] == '#') {
+			send_bytes((const unsigned char *)model, strlen(model));
+			len = 0;
+			continue;
+		}
+		if (len < (int)sizeof(cmd) - 1)
+			cmd[len++] = buf[i];
+	}
+}
+
+static void drain_events(void)
+{
+	struct input_event ev[64];
+	int i, n;
+
+	while ((n = read(event_fd, ev, sizeof(ev))) > 0) {
+		n /= sizeof(ev[0]);
+		events += n;
+		for (i = 0; i < n; i++)
+			if (ev[i].type == EV_SYN && ev[i].code == SYN_REPORT)
+				frames++;
+	}
+}
+
+/* Poll the port, and the event device once there is one. */
+static void wait_io(int timeout)
+{
+	struct pollfd pfd[2] = {
+		{ .fd = userio_fd, .events = POLLIN },
+		{ .fd = event_fd, .events = POLLIN },
+	};
+
+	if (poll(pfd, event_fd < 0 ? 1 : 2, timeout) <= 0)
+		return;
+	if (pfd[0].revents & POLLIN)
+		answer();
+	if (event_fd >= 0 && (pfd[1].revents & POLLIN))
+		drain_events();
+}
+
+static int attach(void)
+{
+	char saved[8];
+	double t;
+	int err = -1;
+
+	/* Without the parameter, nothing would bind to a userio port. */
+	if (read_sysfs(USERIO_PARAM, saved, sizeof(saved)) ||
+	    write_sysfs(USERIO_PARAM, "Y")) {
+		perror("wacom_iv_replay: " USERIO_PARAM);
+		return -1;
+	}
+
+	userio_fd = open("/dev/userio", O_RDWR);
+	if (userio_fd < 0) {
+		perror("wacom_iv_replay: /dev/userio");
+		goto out;
+	}
+	/* The type can only be set before the port is registered. */
+	if (userio_cmd(USERIO_CMD_SET_PORT_TYPE, SERIO_RS232) ||
+	    userio_cmd(USERIO_CMD_REGISTER, 0)) {
+		perror("wacom_iv_replay: userio");
+		goto out;
+	}
+
+	/* Registration is asynchronous. */
+	for (t = now(); find_port(); usleep(10000))
+		if (now() - t > 2) {
+			fprintf(stderr, "wacom_iv_replay: userio port didn't "
+				"appear\n");
+			goto out;
+		}
+
+	/* So is the driver's probe. */
+	for (t = now(); open_event_device(); wait_io(10))
+		if (now() - t > 5) {
+			fprintf(stderr, "wacom_iv_replay: wacom_serial didn't "
+				"register an input device on %s\n", serio);
+			goto out;
+		}
+	err = 0;
+ out:
+	write_sysfs(USERIO_PARAM, saved);
+	return err;
+}
+
+/* When byte i of the capture is due, in seconds from the start: when
+ * its chunk was read, or for a raw dump, when it would have arrived at
+ * the given speed. */
+static double byte_due(const struct capture *c, size_t i, size_t *chunk,
+		       size_t *chunk_end, int baud)
+{
+	if (!c->chunks)
+		return i * 10.0 / baud;
+	if (i == 0)
+		*chunk = *chunk_end = 0;
+	while (i >= *chunk_end)
+		*chunk_end += c->chunks[(*chunk)++].len;
+	return c->chunks[*chunk - 1].time / 1e6;
+}
+
+static unsigned long count_packets(const unsigned char *buf, size_t len)
+{
+	struct wacom_iv_parser parser;
+	unsigned long packets = 0;
+	size_t i;
+
+	wacom_iv_parser_reset(&parser);
+	for (i = 0; i < len; i++)
+		if (wacom_iv_parse_byte(&parser, buf[i], 0) == WACOM_IV_PACKET)
+			packets++;
+	return packets;
+}
+
+int main(int argc, char **argv)
+{
+	struct capture c;
+	size_t i, chunk, chunk_end;
+	unsigned long packets;
+	double t0, dt, self0, all0, start, last;
+	int baud = 0, fast = 0, repeats = 1, r, opt;
+
+	while ((opt = getopt(argc, argv, "b:fr:m:R:C:")) != -1) {
+		switch (opt) {
+		case 'b':
+			baud = atoi(optarg);
+			break;
+		case 'f':
+			fast = 1;
+			break;
+		case 'r':
+			repeats = atoi(optarg);
+			break;
+		case 'm':
+			model = optarg;
+			break;
+		case 'R':
+			config = optarg;
+			break;
+		case 'C':
+			coords = optarg;
+			break;
+		default:
+			optind = argc;
+			break;
+		}
+	}
+	if (optind != argc - 1 || baud < 0 || repeats <= 0) {
+		fprintf(stderr, "Usage: wacom_iv_replay [-b <baud>] [-f] "
+			"[-r <repeats>]\n"
+			"                       [-m <model>] [-R <config>] "
+			"[-C <coords>] capture\n");
+		return EXIT_FAILURE;
+	}
+
+	if (capture_load(&c, argv[optind])) {
+		fprintf(stderr, "wacom_iv_replay: '%s' - %s\n", argv[optind],
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if (!baud)
+		baud = c.baud ? c.baud : 9600;
+	packets = count_packets(c.data, c.len) * repeats;
+	if (!packets) {
+		fprintf(stderr, "wacom_iv_replay: no packets in '%s'\n",
+			argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	if (attach())
+		return EXIT_FAILURE;
+	printf("%s: replaying %lu packets %s\n", serio, packets,
+	       fast ? "as fast as possible" : "in real time");
+	drain_events();
+	events = frames = 0;
+
+	t0 = now();
+	self0 = cpu_self();
+	all0 = cpu_all();
+	for (r = 0; r < repeats; r++) {
+		start = now();
+		for (i = 0; i < c.len; i++) {
+			if (!fast) {
+				double due = start +
+					byte_due(&c, i, &chunk, &chunk_end, baud);
+				double t;
+
+				while ((t = now()) < due)
+					wait_io((int)((due - t) * 1000) + 1);
+			}
+			if (userio_cmd(USERIO_CMD_SEND_INTERRUPT, c.data[i])) {
+				perror("wacom_iv_replay: userio");
+				return EXIT_FAILURE;
+			}
+			if (fast && !(i & 63))
+				drain_events();
+		}
+	}
+
+	/* Wait for the driver to catch up. */
+	for (last = now(); now() - last < 0.2; ) {
+		unsigned long before = events;
+
+		wait_io(50);
+		if (events != before)
+			last = now();
+	}
+	dt = now() - t0;
+
+	printf("%lu packets, %lu events, %lu frames in %.3f s\n",
+	       packets, events, frames, dt);
+	printf("%.0f events/s, %.0f frames/s\n", events / dt, frames / dt);
+	printf("CPU per packet: %.2f us in this process, %.2f us system-wide\n",
+	       (cpu_self() - self0) * 1e6 / packets,
+	       (cpu_all() - all0) * 1e6 / packets);
+
+	capture_free(&c);
+	close(event_fd);
+	close(userio_fd);
+	return EXIT_SUCCESS;
+}
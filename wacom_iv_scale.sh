@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# Time bringing up N emulated tablets at once
+#
+# Starts N wacom_iv_emu instances, attaches each with
+# inputattach --daemon --wacom_iv, all in parallel, and waits for the
+# wacom_serial driver to register N input devices.  Reports how long
+# inputattach took (link speed negotiation) and how long until every
+# tablet was registered (the driver's probe).  Needs root, and the
+# wacom_serial and serport modules loaded.
+#
+# Usage: wacom_iv_scale.sh [<ports>] [<model>]
+
+N=${1:-16}
+MODEL=${2:-digitizer2}
+TIMEOUT=${TIMEOUT:-60}
+DIR=$(mktemp -d /tmp/wacom_iv_scale.XXXXXX)
+NAME="Wacom protocol 4 serial tablet"
+
+count_tablets() {
+	grep -c "^N: Name=\"$NAME\"" /proc/bus/input/devices
+}
+
+cleanup() {
+	for pid in $(cat "$DIR"/inputattach.pid "$DIR"/emu.pid 2>/dev/null); do
+		kill "$pid" 2>/dev/null
+	done
+	rm -rf "$DIR"
+}
+trap cleanup EXIT INT TERM
+
+now() {
+	date +%s.%N
+}
+
+elapsed() {
+	awk "BEGIN { printf \"%.3f\", $(now) - $1 }"
+}
+
+for i in $(seq "$N"); do
+	./wacom_iv_emu -m "$MODEL" -l "$DIR/tty$i" > /dev/null &
+	echo $! >> "$DIR/emu.pid"
+done
+for i in $(seq "$N"); do
+	while [ ! -e "$DIR/tty$i" ]; do sleep 0.01; done
+done
+
+before=$(count_tablets)
+start=$(now)
+pids=
+for i in $(seq "$N"); do
+	./inputattach --daemon --wacom_iv "$DIR/tty$i" &
+	pids="$pids $!"
+done
+# These return once the link is set up and the daemon has forked.
+wait $pids
+attached=$(elapsed "$start")
+pgrep -f "inputattach --daemon --wacom_iv $DIR/" > "$DIR/inputattach.pid"
+
+while [ $(($(count_tablets) - before)) -lt "$N" ]; do
+	if [ "$(elapsed "$start" | cut -d. -f1)" -ge "$TIMEOUT" ]; then
+		echo "only $(($(count_tablets) - before)) of $N tablets" \
+		     "registered after ${TIMEOUT}s" >&2
+		exit 1
+	fi
+	sleep 0.01
+done
+
+echo "$N ports: inputattach took ${attached}s," \
+     "all registered after $(elapsed "$start")s"
@@ -0,0 +1,315 @@
+/*
+ * Behaviour tests for the protocol 4 framing and decoding code
+ *
+ * Drives wacom_iv_parse_byte() and wacom_iv_parser_flush() with clean,
+ * noisy, cut-off, pipelined and overflowing streams, and checks what
+ * comes out and what the line noise counters say.  Also loads captures
+ * in the format inputattach --capture writes.  Run by make check.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "wacom_iv.h"
+
+static int failures;
+
+#define CHECK(cond) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "%s:%d: %s: failed: %s\n", __FILE__,	\
+			__LINE__, __func__, #cond);			\
+		failures++;						\
+	}								\
+} while (0)
+
+/* A pen packet at x 1000, y 2000, no pressure with one extra bit. */
+static const unsigned char packet[WACOM_IV_PACKET_LENGTH] = {
+	0xe0, 0x07, 0x68, 0x00, 0x0f, 0x50, 0x40
+};
+
+/* Feed len bytes, and return how many of each result came out. */
+static void feed(struct wacom_iv_parser *p, const void *buf, int len,
+		 int counts[4])
+{
+	const unsigned char *c = buf;
+	int i;
+
+	memset(counts, 0, 4 * sizeof(*counts));
+	for (i = 0; i < len; i++)
+		counts[wacom_iv_parse_byte(p, c[i], 0)]++;
+}
+
+static void test_packet(void)
+{
+	struct wacom_iv_parser p;
+	int n[4];
+
+	wacom_iv_parser_reset(&p);
+	feed(&p, packet, sizeof(packet), n);
+	CHECK(n[WACOM_IV_PACKET] == 1);
+	CHECK(p.len == WACOM_IV_PACKET_LENGTH);
+	CHECK(!memcmp(p.data, packet, sizeof(packet)));
+	CHECK(!p.dropped_bytes && !p.discarded_packets && !p.resyncs);
+}
+
+static void test_noise(void)
+{
+	struct wacom_iv_parser p;
+	int n[4];
+
+	wacom_iv_parser_reset(&p);
+	feed(&p, "\x11\x22\x33", 3, n);
+	CHECK(n[WACOM_IV_NEED_MORE] == 3);
+	feed(&p, packet, sizeof(packet), n);
+	CHECK(n[WACOM_IV_PACKET] == 1);
+	CHECK(p.dropped_bytes == 3);
+	CHECK(p.resyncs == 1);
+}
+
+static void test_cut_off_packet(void)
+{
+	struct wacom_iv_parser p;
+	int n[4];
+
+	wacom_iv_parser_reset(&p);
+	feed(&p, packet, 4, n);
+	feed(&p, packet, sizeof(packet), n);
+	CHECK(n[WACOM_IV_PACKET] == 1);
+	CHECK(!memcmp(p.data, packet, sizeof(packet)));
+	CHECK(p.discarded_packets == 1);
+	CHECK(p.dropped_bytes == 4);
+	CHECK(p.resyncs == 1);
+}
+
+static void test_error_byte(void)
+{
+	struct wacom_iv_parser p;
+	int n[4];
+
+	wacom_iv_parser_reset(&p);
+	feed(&p, packet, 3, n);
+	CHECK(wacom_iv_parse_byte(&p, packet[3], 1) == WACOM_IV_NEED_MORE);
+	/* The rest of the damaged packet is noise. */
+	feed(&p, packet + 4, 3, n);
+	CHECK(n[WACOM_IV_NEED_MORE] == 3);
+	feed(&p, packet, sizeof(packet), n);
+	CHECK(n[WACOM_IV_PACKET] == 1);
+	CHECK(p.discarded_packets == 1);
+	CHECK(p.dropped_bytes == 3 + 1 + 3);
+}
+
+static void test_response(void)
+{
+	struct wacom_iv_parser p;
+	int n[4];
+
+	wacom_iv_parser_reset(&p);
+	feed(&p, "~#UD-1212-R00 V1.3-6\r", 21, n);
+	CHECK(n[WACOM_IV_RESPONSE] == 1);
+	CHECK(!strcmp((char *)p.data, "~#UD-1212-R00 V1.3-6"));
+}
+
+/* Answers to requests sent together, with no CR between them. */
+static void test_pipelined(void)
+{
+	struct wacom_iv_parser p;
+
+	wacom_iv_parser_reset(&p);
+	feed(&p, "~#CT-0405-R00 V1.3-5", 20, (int[4]){ 0 });
+	CHECK(wacom_iv_parse_byte(&p, '~', 0) == WACOM_IV_RESPONSE);
+	CHECK(!strcmp((char *)p.data, "~#CT-0405-R00 V1.3-5"));
+	feed(&p, "RE202C900\r", 10, (int[4]){ 0 });
+	CHECK(!strcmp((char *)p.data, "~RE202C900"));
+	CHECK(!p.dropped_bytes && !p.resyncs);
+}
+
+/* A response with no CR (the PenPartner's) ends when the line goes
+ * quiet. */
+static void test_flush_response(void)
+{
+	struct wacom_iv_parser p;
+
+	wacom_iv_parser_reset(&p);
+	feed(&p, "~#CT-0405", 9, (int[4]){ 0 });
+	CHECK(wacom_iv_parser_flush(&p) == WACOM_IV_RESPONSE);
+	CHECK(!strcmp((char *)p.data, "~#CT-0405"));
+	CHECK(wacom_iv_parser_flush(&p) == WACOM_IV_NEED_MORE);
+}
+
+/* Half a packet is not a response. */
+static void test_flush_packet(void)
+{
+	struct wacom_iv_parser p;
+	int n[4];
+
+	wacom_iv_parser_reset(&p);
+	feed(&p, packet, 3, n);
+	CHECK(wacom_iv_parser_flush(&p) == WACOM_IV_NEED_MORE);
+	CHECK(p.discarded_packets == 1);
+	CHECK(p.dropped_bytes == 3);
+	feed(&p, packet, sizeof(packet), n);
+	CHECK(n[WACOM_IV_PACKET] == 1);
+}
+
+static void test_overflow(void)
+{
+	struct wacom_iv_parser p;
+	char buf[WACOM_IV_BUFFER_SIZE + 8];
+	int n[4];
+
+	memset(buf, 'x', sizeof(buf));
+	buf[0] = '~';
+	buf[sizeof(buf) - 1] = '\r';
+
+	wacom_iv_parser_reset(&p);
+	feed(&p, buf, sizeof(buf), n);
+	CHECK(n[WACOM_IV_OVERFLOW] == 1);
+	CHECK(n[WACOM_IV_RESPONSE] == 0);
+	CHECK(p.discarded == WACOM_IV_BUFFER_SIZE);
+	CHECK(p.dropped_bytes == sizeof(buf));
+	feed(&p, packet, sizeof(packet), n);
+	CHECK(n[WACOM_IV_PACKET] == 1);
+	CHECK(p.resyncs == 1);
+}
+
+static void test_decode(void)
+{
+	const struct wacom_iv_decoder *d = wacom_iv_get_decoder(1);
+	struct wacom_iv_packet pkt;
+
+	CHECK(d != NULL);
+	CHECK(wacom_iv_get_decoder(-1) == NULL);
+	CHECK(wacom_iv_get_decoder(WACOM_IV_MAX_EXTRA_Z_BITS + 1) == NULL);
+	if (!d)
+		return;
+	d->decode(packet, &pkt);
+	CHECK(pkt.in_proximity);
+	CHECK(pkt.tool == WACOM_IV_STYLUS);
+	CHECK(pkt.x == 1000 && pkt.y == 2000);
+	CHECK(pkt.z == 0);
+	CHECK(pkt.button == 0);
+}
+
+/* Both extra pressure bits set, which each layout takes differently. */
+static void test_decode_layouts(void)
+{
+	static const unsigned char data[2][WACOM_IV_PACKET_LENGTH] = {
+		{ 0xe4, 0x07, 0x68, 0x04, 0x0f, 0x50, 0x29 },
+		{ 0xa0, 0x07, 0x68, 0x08, 0x0f, 0x50, 0x40 },
+	};
+	static const int z[WACOM_IV_MAX_EXTRA_Z_BITS + 1] = {
+		0x69, 0xd3, 0x1a7
+	};
+	struct wacom_iv_packet pkt, batch[2];
+	int bits;
+
+	for (bits = 0; bits <= WACOM_IV_MAX_EXTRA_Z_BITS; bits++) {
+		const struct wacom_iv_decoder *d = wacom_iv_get_decoder(bits);
+
+		d->decode(data[0], &pkt);
+		CHECK(pkt.in_proximity && pkt.tool == WACOM_IV_STYLUS);
+		CHECK(pkt.x == 1000 && pkt.y == 2000);
+		CHECK(pkt.z == z[bits]);
+		CHECK(pkt.button == 0);
+
+		d->decode_batch(data[0], 2, batch);
+		CHECK(!memcmp(&batch[0], &pkt, sizeof(pkt)));
+		d->decode(data[1], &pkt);
+		CHECK(!memcmp(&batch[1], &pkt, sizeof(pkt)));
+		CHECK(!pkt.in_proximity && pkt.button == 1);
+	}
+}
+
+/* Write a capture of one-byte chunks, the given time apart, and load
+ * it back. */
+static int load_capture(struct capture *c, const uint64_t *deltas, int n)
+{
+	char path[] = "/tmp/wacom_iv_test.XXXXXX";
+	struct capture_header h;
+	unsigned char head[2 * CAPTURE_VARINT_MAX];
+	FILE *f;
+	int fd, i, len, ret = -1;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return -1;
+	f = fdopen(fd, "wb");
+	if (!f) {
+		close(fd);
+		unlink(path);
+		return -1;
+	}
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN);
+	h.version = CAPTURE_VERSION;
+	h.baud = 9600;
+	fwrite(&h, sizeof(h), 1, f);
+	for (i = 0; i < n; i++) {
+		len = capture_put_varint(head, deltas[i]);
+		len += capture_put_varint(head + len, 1);
+		fwrite(head, 1, len, f);
+		fputc(packet[i % sizeof(packet)], f);
+	}
+	if (!fclose(f))
+		ret = capture_load(c, path);
+	unlink(path);
+	return ret;
+}
+
+static void test_capture(void)
+{
+	static const uint64_t deltas[] = { 0, 1, 127, 128, 1000000, 3 };
+	struct capture c;
+	uint64_t time = 0;
+	size_t i;
+
+	CHECK(!load_capture(&c, deltas, 6));
+	CHECK(c.baud == 9600);
+	CHECK(c.nchunks == 6 && c.len == 6);
+	for (i = 0; i < c.nchunks && i < 6; i++) {
+		time += deltas[i];
+		CHECK(c.chunks[i].time == time);
+		CHECK(c.chunks[i].len == 1);
+	}
+	capture_free(&c);
+}
+
+/* A file begun later than its first chunk was read, as inputattach
+ * --rotate used to write: the times wrap round and back. */
+static void test_capture_wrap(void)
+{
+	static const uint64_t deltas[] = {
+		5, 18446744073709406ULL, -18446744073709406ULL + 1000
+	};
+	struct capture c;
+
+	CHECK(load_capture(&c, deltas, 3) == -1 && errno == EINVAL);
+}
+
+int main(void)
+{
+	test_packet();
+	test_noise();
+	test_cut_off_packet();
+	test_error_byte();
+	test_response();
+	test_pipelined();
+	test_flush_response();
+	test_flush_packet();
+	test_overflow();
+	test_decode();
+	test_decode_layouts();
+	test_capture();
+	test_capture_wrap();
+
+	if (failures) {
+		fprintf(stderr, "wacom_iv_test: %d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("wacom_iv_test: all passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,1915 @@
+/*
+ * Wacom protocol 4 serial tablet driver
+ *
+ * Many thanks to Bill Seremetis, without whom PenPartner support
+ * would not have been possible.
+ *
+ * Thanks to Patrick Mahoney.
+ *
+ * Sections I have been unable to test personally due to lack of
+ * available hardware are marked UNTESTED.  Much of what is marked
+ * UNTESTED comes from reading the wcmSerial code in linuxwacom 0.9.0.
+ * If you have a tablet that corresponds to an UNTESTED section,
+ * please email me your results.
+ *
+ * To do:
+ *  - support pad buttons;
+ *  - support (protocol 4-style) tilt;
+ *  - support suppress;
+ *  - support Graphire relative wheel.
+ *
+ * This driver was developed with reference to much code written by others,
+ * particularly:
+ *  - elo, gunze drivers by Vojtech Pavlik <vojtech@ucw.cz>;
+ *  - wacom_w8001 driver by Jaya Kumar <jayakumar.lkml@gmail.com>;
+ *  - the USB wacom input driver, credited to many people
+ *    (see drivers/input/tablet/wacom.h);
+ *  - new and old versions of linuxwacom / xf86-input-wacom credited to
+ *    Frederic Lepied, France. <Lepied@XFree86.org> and
+ *    Ping Cheng, Wacom. <pingc@wacom.com>;
+ *  - and xf86wacom.c (a presumably ancient version of the linuxwacom code), by
+ *    Frederic Lepied and Raph Levien <raph@gtk.org>.
+ */
+
+#include <linux/string.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/input.h>
+#include <linux/serio.h>
+#include <linux/slab.h>
+#include <linux/completion.h>
+#include <linux/kfifo.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/firmware.h>
+#include <linux/list.h>
+#include <linux/moduleparam.h>
+#include <linux/sysfs.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/atomic.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/version.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/uaccess.h>
+
+#include "wacom_iv.h"
+
+#define CREATE_TRACE_POINTS
+#include "wacom_serial_trace.h"
+
+/* XXX To be removed before (widespread) release. */
+#ifndef SERIO_WACOM_IV
+#define SERIO_WACOM_IV 0x3e
+#endif
+
+#define DRIVER_AUTHOR	"Julian Squires <julian@cipht.net>"
+#define DEVICE_NAME	"Wacom protocol 4 serial tablet"
+#define DRIVER_DESC	DEVICE_NAME " driver"
+
+MODULE_AUTHOR(DRIVER_AUTHOR);
+MODULE_DESCRIPTION(DRIVER_DESC);
+MODULE_LICENSE("GPL");
+
+#define REQUEST_MODEL_AND_ROM_VERSION	"~#"
+#define REQUEST_MAX_COORDINATES		"~C\r"
+#define REQUEST_CONFIGURATION_STRING	"~R\r"
+#define REQUEST_RESET_TO_PROTOCOL_IV	"\r#"
+/* Note: sending "\r$\r" causes at least the Digitizer II to send
+ * packets in ASCII instead of binary.  "\r#" seems to undo that. */
+
+#define COMMAND_START_SENDING_PACKETS		"ST\r"
+#define COMMAND_STOP_SENDING_PACKETS		"SP\r"
+#define COMMAND_MULTI_MODE_INPUT		"MU1\r"
+#define COMMAND_ORIGIN_IN_UPPER_LEFT		"OC1\r"
+#define COMMAND_ENABLE_ALL_MACRO_BUTTONS	"~M0\r"
+#define COMMAND_DISABLE_GROUP_1_MACRO_BUTTONS	"~M1\r"
+#define COMMAND_TRANSMIT_AT_MAX_RATE		"IT0\r"
+#define COMMAND_DISABLE_INCREMENTAL_MODE	"IN0\r"
+#define COMMAND_ENABLE_CONTINUOUS_MODE		"SR\r"
+#define COMMAND_ENABLE_PRESSURE_MODE		"PH1\r"
+#define COMMAND_Z_FILTER			"ZF1\r"
+
+/* device IDs from wacom_wac.h */
+#define STYLUS_DEVICE_ID	0x02
+#define TOUCH_DEVICE_ID         0x03
+#define CURSOR_DEVICE_ID        0x06
+#define ERASER_DEVICE_ID        0x0A
+#define PAD_DEVICE_ID           0x0F
+
+/* Protocol IV tools have no serial numbers of their own, so each kind
+ * of tool gets a fixed one for MSC_SERIAL.  The stylus and eraser are
+ * two ends of the same pen, and share it. */
+#define PEN_SERIAL	0x01
+#define CURSOR_SERIAL	0x02
+#define TOUCH_SERIAL	0x03
+#define PAD_SERIAL	0xF0
+
+#define WACOM_NTOOLS	(WACOM_IV_TOUCH + 1)
+
+static const struct { int device_id; int input_id; int serial; } tools[] = {
+	{ 0,0,0 },
+	{ STYLUS_DEVICE_ID, BTN_TOOL_PEN, PEN_SERIAL },
+	{ ERASER_DEVICE_ID, BTN_TOOL_RUBBER, PEN_SERIAL },
+	{ PAD_DEVICE_ID, 0, PAD_SERIAL },
+	{ CURSOR_DEVICE_ID, BTN_TOOL_MOUSE, CURSOR_SERIAL },
+	{ TOUCH_DEVICE_ID, BTN_TOOL_FINGER, TOUCH_SERIAL }
+};
+
+/* How long the line must stay quiet before we consider a response
+ * (or the tablet's answers to our requests) to be over. */
+#define WACOM_IDLE_GAP	msecs_to_jiffies(100)
+
+/* Axes whose fuzz and flat can be calibrated or set through sysfs,
+ * indexing wacom->fuzz[] and wacom->flat[]. */
+enum { AXIS_X, AXIS_Y, AXIS_PRESSURE, WACOM_NAXES };
+
+static const unsigned int wacom_axes[WACOM_NAXES] = {
+	[AXIS_X] = ABS_X, [AXIS_Y] = ABS_Y, [AXIS_PRESSURE] = ABS_PRESSURE
+};
+
+/* Hovering samples needed to calibrate.  A wider spread than
+ * WACOM_CALIBRATION_MAX_NOISE on any axis means the pen moved, and
+ * counting starts over. */
+#define WACOM_CALIBRATION_SAMPLES	64
+#define WACOM_CALIBRATION_MAX_NOISE	16
+
+static unsigned int max_rate;
+module_param(max_rate, uint, 0644);
+MODULE_PARM_DESC(max_rate, "Default maximum frames per second per tool, "
+		 "or 0 for no limit");
+
+static bool calibrate;
+module_param(calibrate, bool, 0644);
+MODULE_PARM_DESC(calibrate, "Measure the sensor noise while the pen first "
+		 "hovers, and set fuzz and flat from it");
+
+/* userio can set a port's type but not its protocol, so the ports it
+ * makes for wacom_iv_replay look like any other serial line. */
+static bool userio;
+module_param(userio, bool, 0644);
+MODULE_PARM_DESC(userio, "Also bind to serial ports with no protocol set, "
+		 "such as those made through /dev/userio");
+
+/* Bits in wacom->pending. */
+enum { REQUEST_MODEL, REQUEST_CONFIGURATION, REQUEST_COORDINATES };
+
+/* Bytes waiting between wacom_interrupt() and wacom_work(); must be
+ * a power of two.  About a quarter second at 38400 baud. */
+#define WACOM_FIFO_SIZE 1024
+
+enum {
+	MODEL_CINTIQ		= 0x504C, /* PL */
+	MODEL_CINTIQ2		= 0x4454, /* DT */
+	MODEL_DIGITIZER_II	= 0x5544, /* UD */
+	MODEL_GRAPHIRE		= 0x4554, /* ET */
+	MODEL_INTUOS		= 0x4744, /* GD */
+	MODEL_INTUOS2		= 0x5844, /* XD */
+	MODEL_PENPARTNER	= 0x4354, /* CT */
+	MODEL_UNKNOWN		= 0
+};
+
+#define SETUP_CINTIQ	COMMAND_ORIGIN_IN_UPPER_LEFT		\
+			COMMAND_TRANSMIT_AT_MAX_RATE		\
+			COMMAND_ENABLE_CONTINUOUS_MODE
+#define SETUP_PENPARTNER COMMAND_ENABLE_PRESSURE_MODE
+#define SETUP_DEFAULT	COMMAND_MULTI_MODE_INPUT		\
+			COMMAND_ORIGIN_IN_UPPER_LEFT		\
+			COMMAND_ENABLE_ALL_MACRO_BUTTONS	\
+			COMMAND_DISABLE_GROUP_1_MACRO_BUTTONS	\
+			COMMAND_TRANSMIT_AT_MAX_RATE		\
+			COMMAND_DISABLE_INCREMENTAL_MODE	\
+			COMMAND_ENABLE_CONTINUOUS_MODE		\
+			COMMAND_Z_FILTER
+
+/* None of these start the tablet sending packets; wacom_open() does
+ * that, and wacom_close() stops it again. */
+
+/* What we know about a model before asking it anything.  Zero
+ * coordinates or resolution mean the tablet's answer is used. */
+struct wacom_model {
+	int id;			/* first two letters of the model string */
+	int sub_id;		/* two letters after the dash, or 0 for any */
+	int min_version;	/* major<<8 | minor */
+	int max_version;	/* major<<8 | minor, or 0 for any */
+	const char *name;
+	int version;		/* reported as input_id.version */
+	int max_x, max_y;
+	int res_x, res_y;
+	int extra_z_bits;
+	const char *setup;
+	unsigned long skip;	/* REQUEST_* bits the model doesn't answer */
+	bool unsupported;
+};
+
+/* The first matching entry wins; the last one matches anything. */
+static const struct wacom_model wacom_models[] = {
+	{	/* UNTESTED */
+		.id = MODEL_INTUOS, .name = "Intuos",
+		.version = MODEL_INTUOS, .extra_z_bits = 1,
+		.setup = SETUP_DEFAULT, .unsupported = true,
+	},
+	{
+		.id = MODEL_INTUOS2, .name = "Intuos",
+		.version = MODEL_INTUOS, .extra_z_bits = 1,
+		.setup = SETUP_DEFAULT, .unsupported = true,
+	},
+	{	/* UNTESTED; PL-710.  wcmSerial sets res 2540x2540. */
+		.id = MODEL_CINTIQ, .sub_id = 0x3731, .name = "Cintiq",
+		.version = MODEL_CINTIQ, .res_x = 2540, .res_y = 2540,
+		.extra_z_bits = 2, .setup = SETUP_CINTIQ,
+	},
+	{	/* UNTESTED; PL-550 */
+		.id = MODEL_CINTIQ, .sub_id = 0x3535, .name = "Cintiq",
+		.version = MODEL_CINTIQ, .extra_z_bits = 2,
+		.setup = SETUP_CINTIQ,
+	},
+	{	/* UNTESTED; PL-800 */
+		.id = MODEL_CINTIQ, .sub_id = 0x3830, .name = "Cintiq",
+		.version = MODEL_CINTIQ, .extra_z_bits = 2,
+		.setup = SETUP_CINTIQ,
+	},
+	{	/* UNTESTED */
+		.id = MODEL_CINTIQ, .name = "Cintiq",
+		.version = MODEL_CINTIQ, .extra_z_bits = 1,
+		.setup = SETUP_CINTIQ,
+	},
+	/* The same sub-ids under DT. */
+	{
+		.id = MODEL_CINTIQ2, .sub_id = 0x3731, .name = "Cintiq",
+		.version = MODEL_CINTIQ, .res_x = 2540, .res_y = 2540,
+		.extra_z_bits = 2, .setup = SETUP_CINTIQ,
+	},
+	{
+		.id = MODEL_CINTIQ2, .sub_id = 0x3535, .name = "Cintiq",
+		.version = MODEL_CINTIQ, .extra_z_bits = 2,
+		.setup = SETUP_CINTIQ,
+	},
+	{
+		.id = MODEL_CINTIQ2, .sub_id = 0x3830, .name = "Cintiq",
+		.version = MODEL_CINTIQ, .extra_z_bits = 2,
+		.setup = SETUP_CINTIQ,
+	},
+	{
+		.id = MODEL_CINTIQ2, .name = "Cintiq",
+		.version = MODEL_CINTIQ, .extra_z_bits = 1,
+		.setup = SETUP_CINTIQ,
+	},
+	{	/* wcmSerial sets res 1000x1000. */
+		.id = MODEL_PENPARTNER, .name = "Penpartner",
+		.version = MODEL_PENPARTNER, .res_x = 1000, .res_y = 1000,
+		.extra_z_bits = 1, .setup = SETUP_PENPARTNER,
+	},
+	{	/* Apparently Graphire models do not answer coordinate
+		 * requests. */
+		.id = MODEL_GRAPHIRE, .name = "Graphire",
+		.version = MODEL_GRAPHIRE, .max_x = 5103, .max_y = 3711,
+		.res_x = 1016, .res_y = 1016, .extra_z_bits = 2,
+		.setup = SETUP_DEFAULT, .skip = BIT(REQUEST_COORDINATES),
+	},
+	{	/* UNTESTED; versions 1.0 to 1.2 only, not 0.x or a
+		 * version we couldn't parse. */
+		.id = MODEL_DIGITIZER_II,
+		.min_version = 0x0100, .max_version = 0x0102,
+		.name = "Digitizer II", .version = MODEL_DIGITIZER_II,
+		.extra_z_bits = 0, .setup = SETUP_DEFAULT,
+	},
+	{
+		.id = MODEL_DIGITIZER_II, .name = "Digitizer II",
+		.version = MODEL_DIGITIZER_II, .extra_z_bits = 1,
+		.setup = SETUP_DEFAULT,
+	},
+	{	/* UNTESTED */
+		.id = MODEL_UNKNOWN, .name = "Unknown Protocol IV",
+		.version = MODEL_UNKNOWN, .extra_z_bits = 1,
+		.setup = SETUP_DEFAULT,
+	},
+};
+
+/*
+ * Quirks for models missing from (or wrong in) wacom_models[] can be
+ * supplied without rebuilding the module, in the firmware file
+ * "wacom_serial_models", one model per line:
+ *
+ *   <id>[-<sub id>] <name> <max x> <max y> <x res> <y res> <extra z bits> <skip> [<setup>]
+ *
+ * <id> and <sub id> are the two letters after "~#" and after the dash
+ * in the model string (for example "ET" or "PL-71"); <skip> is any of
+ * R and C, or "-"; and <setup> is a comma-separated list of commands
+ * (for example "IT0,SR"); ST is pointless there, since SP always
+ * follows, and ST is sent when the input device is opened.  Entries
+ * here take precedence over the built-in table.  Lines starting with '#' are ignored.
+ */
+#define WACOM_MODELS_FIRMWARE	"wacom_serial_models"
+
+struct wacom_byte {
+	ktime_t time;		/* arrival, in wacom_interrupt() */
+	unsigned char data;
+	unsigned char flags;	/* SERIO_PARITY, SERIO_FRAME */
+};
+
+/* Bytes the tap holds for its reader; must be a power of two.  About
+ * a second at 38400 baud. */
+#define WACOM_TAP_SIZE 4096
+
+/*
+ * Every byte received, copied by wacom_interrupt() for whoever has
+ * /sys/kernel/debug/wacom_serial/serioN/tap open, one line per byte:
+ * arrival time in ns, the byte in hex, and "parity" or "frame" if the
+ * UART flagged it.  The tap exists only while the file is open, and
+ * outlives the port if it is still open when the port goes away.
+ */
+struct wacom_tap {
+	DECLARE_KFIFO(fifo, struct wacom_byte, WACOM_TAP_SIZE);
+	wait_queue_head_t wait;
+	struct mutex lock;	/* one reader at a time */
+	atomic_long_t dropped;	/* bytes the reader fell behind by */
+	struct wacom *wacom;	/* NULL once detached */
+};
+
+/* Bucket i counts intervals of [2^(i-1), 2^i) microseconds; the last
+ * one also counts everything longer. */
+#define WACOM_HIST_BUCKETS 20
+
+struct wacom_hist {
+	atomic_long_t bucket[WACOM_HIST_BUCKETS];
+};
+
+/* Shown (and reset by writing anything) in
+ * /sys/kernel/debug/wacom_serial/serioN/stats, along with the parser's
+ * line noise counters.  Nothing but atomic_long_t in here, so it can
+ * be reset as an array. */
+struct wacom_stats {
+	atomic_long_t bytes, packets, responses, garbled, overflows;
+	atomic_long_t fifo_dropped;		/* wacom_work() fell behind */
+	atomic_long_t coalesced;		/* held back by max_rate */
+	struct wacom_hist byte_gap;		/* between received bytes */
+	struct wacom_hist packet_interval;	/* between packets */
+	struct wacom_hist latency;		/* last byte to input_sync() */
+};
+
+struct wacom {
+	struct input_dev *dev;
+	struct serio *serio;
+	struct completion cmd_done;
+	struct delayed_work idle_work;
+	unsigned long pending;	/* requests still awaiting a response */
+	bool registered;
+	int extra_z_bits;
+	const struct wacom_iv_decoder *decoder;	/* for extra_z_bits */
+	/* The last packet seen from each tool, indexed like tools[].
+	 * In multi-mode (MU1) the pen and puck take turns. */
+	struct wacom_iv_packet tool_state[WACOM_NTOOLS];
+	/* The last packet from each tool passed on to be reported. */
+	struct wacom_iv_packet tool_reported[WACOM_NTOOLS];
+	const struct wacom_model *model;
+	/* Quirks file, held only while probing, and the entry parsed
+	 * from it. */
+	const struct firmware *quirks;
+	struct wacom_model quirk_model;
+	char quirk_name[16], quirk_setup[64];
+	/* The model response, without the "~#". */
+	char model_string[WACOM_IV_BUFFER_SIZE];
+	/* The interrupt handler is the only producer and wacom_work()
+	 * the only consumer, so the fifo needs no lock. */
+	DECLARE_KFIFO(fifo, struct wacom_byte, WACOM_FIFO_SIZE);
+	/* Set and cleared with serio_pause_rx(), and under
+	 * wacom_tap_lock. */
+	struct wacom_tap *tap;
+	bool tap_disabled;	/* the port is going away */
+	struct wacom_stats stats;
+	struct dentry *debugfs;
+	ktime_t byte_time, last_byte_time, last_packet_time;
+	/* When the packet being received started on the wire: the
+	 * arrival of its first byte, less that byte's line time. */
+	ktime_t packet_start, byte_line_time;
+	struct work_struct work;
+	/* Serializes the parser, response handling and pending
+	 * between wacom_work(), wacom_idle_work() and wacom_setup(). */
+	struct mutex lock;
+	struct wacom_iv_parser parser;
+	unsigned char last_packet[WACOM_IV_PACKET_LENGTH];
+	/* Fuzz and flat for each of wacom_axes[], either measured or
+	 * set through sysfs, which takes precedence. */
+	int fuzz[WACOM_NAXES], flat[WACOM_NAXES];
+	bool abs_override;
+	bool calibrating;
+	int cal_samples, cal_min[WACOM_NAXES], cal_max[WACOM_NAXES];
+	/* Output rate limiting: 0, or the shortest time between frames.
+	 * Each tool has its own waiting packet, with a bit in
+	 * coalesce_pending; they and next_report are shared with the
+	 * timer, under coalesce_lock. */
+	ktime_t min_interval;
+	struct hrtimer coalesce_timer;
+	spinlock_t coalesce_lock;
+	unsigned long coalesce_pending;
+	struct wacom_iv_packet coalesced[WACOM_NTOOLS];
+	ktime_t coalesced_time[WACOM_NTOOLS], coalesced_start[WACOM_NTOOLS];
+	ktime_t next_report;
+	char phys[32];
+};
+
+
+static void hist_add(struct wacom_hist *h, ktime_t interval)
+{
+	s64 us = ktime_to_us(interval);
+	int i = us > 0 ? fls64(us) : 0;
+
+	atomic_long_inc(&h->bucket[min(i, WACOM_HIST_BUCKETS - 1)]);
+}
+
+static void set_abs_max(struct wacom *wacom, int axis, int max)
+{
+	input_set_abs_params(wacom->dev, wacom_axes[axis], 0, max,
+			     wacom->fuzz[axis], wacom->flat[axis]);
+}
+
+/* Apply new fuzz and flat values, the way EVIOCSABS does, since the
+ * device may be registered and in use by now. */
+static void update_abs(struct wacom *wacom)
+{
+	struct input_dev *dev = wacom->dev;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&dev->event_lock, flags);
+	for (i = 0; i < WACOM_NAXES; i++) {
+		if (!test_bit(wacom_axes[i], dev->absbit))
+			continue;
+		input_abs_set_fuzz(dev, wacom_axes[i], wacom->fuzz[i]);
+		input_abs_set_flat(dev, wacom_axes[i], wacom->flat[i]);
+	}
+	spin_unlock_irqrestore(&dev->event_lock, flags);
+}
+
+static int model_id(const char *s)
+{
+	return s[0] << 8 | s[1];
+}
+
+/* Fill in wacom->quirk_model from a line of the quirks file, if it
+ * describes the model we are talking to. */
+static bool parse_quirk(struct wacom *wacom, const char *line, int id,
+			int sub_id)
+{
+	struct wacom_model *m = &wacom->quirk_model;
+	char ids[8], skip[4], setup[48];
+	char *p;
+	int n;
+
+	setup[0] = 0;
+	n = sscanf(line, "%7s %15s %d %d %d %d %d %3s %47s", ids,
+		   wacom->quirk_name, &m->max_x, &m->max_y, &m->res_x,
+		   &m->res_y, &m->extra_z_bits, skip, setup);
+	if (n < 8 || strlen(ids) < 2 || model_id(ids) != id)
+		return false;
+	if (!wacom_iv_get_decoder(m->extra_z_bits))
+		return false;
+	if (ids[2] == '-' && strlen(ids) == 5 && model_id(ids + 3) != sub_id)
+		return false;
+
+	m->id = id;
+	m->name = wacom->quirk_name;
+	m->version = id;
+	m->skip = 0;
+	if (strchr(skip, 'R'))
+		m->skip |= BIT(REQUEST_CONFIGURATION);
+	if (strchr(skip, 'C'))
+		m->skip |= BIT(REQUEST_COORDINATES);
+	m->unsupported = false;
+
+	m->setup = SETUP_DEFAULT;
+	if (setup[0]) {
+		for (p = setup; *p; p++)
+			if (*p == ',')
+				*p = '\r';
+		snprintf(wacom->quirk_setup, sizeof(wacom->quirk_setup),
+			 "%s\r", setup);
+		m->setup = wacom->quirk_setup;
+	}
+	return true;
+}
+
+static const struct wacom_model *find_quirk(struct wacom *wacom, int id,
+					    int sub_id)
+{
+	const char *p, *end, *eol;
+	char line[128];
+
+	if (!wacom->quirks)
+		return NULL;
+
+	p = (const char *)wacom->quirks->data;
+	end = p + wacom->quirks->size;
+	for (; p < end; p = eol + 1) {
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		if (*p == '#' || eol - p >= sizeof(line))
+			continue;
+		memcpy(line, p, eol - p);
+		line[eol - p] = 0;
+		if (parse_quirk(wacom, line, id, sub_id))
+			return &wacom->quirk_model;
+	}
+	return NULL;
+}
+
+static const struct wacom_model *find_model(struct wacom *wacom,
+					    int version)
+{
+	const unsigned char *data = wacom->parser.data;
+	const struct wacom_model *m;
+	int id, sub_id;
+
+	id = data[2] << 8 | data[3];
+	sub_id = data[5] << 8 | data[6];
+
+	m = find_quirk(wacom, id, sub_id);
+	if (m)
+		return m;
+
+	for (m = wacom_models; m->id != MODEL_UNKNOWN; m++)
+		if (m->id == id &&
+		    (!m->sub_id || m->sub_id == sub_id) &&
+		    version >= m->min_version &&
+		    (!m->max_version || version <= m->max_version))
+			return m;
+
+	dev_dbg(&wacom->dev->dev, "Didn't understand Wacom model "
+		                  "string: %s\n", data);
+	return m;
+}
+
+static void handle_model_response(struct wacom *wacom)
+{
+	const struct wacom_model *m;
+	int major_v, minor_v, max_z;
+	char *p;
+
+	major_v = minor_v = 0;
+	p = strrchr(wacom->parser.data, 'V');
+	if (p)
+		sscanf(p+1, "%u.%u", &major_v, &minor_v);
+
+	strscpy(wacom->model_string, wacom->parser.data + 2,
+		sizeof(wacom->model_string));
+	m = find_model(wacom, major_v << 8 | minor_v);
+	wacom->model = m;
+	wacom->dev->id.version = m->version;
+	wacom->extra_z_bits = m->extra_z_bits;
+	wacom->decoder = wacom_iv_get_decoder(m->extra_z_bits);
+	if (m->unsupported)
+		dev_info(&wacom->dev->dev, "%s tablets are not supported by"
+			 " this driver.\n", m->name);
+	if (m->max_x && m->max_y) {
+		set_abs_max(wacom, AXIS_X, m->max_x);
+		set_abs_max(wacom, AXIS_Y, m->max_y);
+	}
+	if (m->res_x && m->res_y) {
+		input_abs_set_res(wacom->dev, ABS_X, m->res_x);
+		input_abs_set_res(wacom->dev, ABS_Y, m->res_y);
+	}
+
+	max_z = (1<<(7+wacom->extra_z_bits))-1;
+	dev_info(&wacom->dev->dev, "Wacom tablet: %s, version %u.%u\n",
+		 m->name, major_v, minor_v);
+	dev_dbg(&wacom->dev->dev, "Max pressure: %d.\n", max_z);
+	set_abs_max(wacom, AXIS_PRESSURE, max_z);
+}
+
+
+static void handle_configuration_response(struct wacom *wacom)
+{
+	int x, y, skip;
+
+	dev_dbg(&wacom->dev->dev, "Configuration string: %s\n", wacom->parser.data);
+	sscanf(wacom->parser.data, "~R%x,%u,%u,%u,%u", &skip, &skip, &skip, &x, &y);
+	input_abs_set_res(wacom->dev, ABS_X, x);
+	input_abs_set_res(wacom->dev, ABS_Y, y);
+}
+
+static void handle_coordinates_response(struct wacom *wacom)
+{
+	int x, y;
+
+	dev_dbg(&wacom->dev->dev, "Coordinates string: %s\n", wacom->parser.data);
+	sscanf(wacom->parser.data, "~C%u,%u", &x, &y);
+	set_abs_max(wacom, AXIS_X, x);
+	set_abs_max(wacom, AXIS_Y, y);
+}
+
+static void handle_response(struct wacom *wacom)
+{
+	trace_wacom_response(wacom->serio, wacom->parser.data,
+			     wacom->parser.len);
+	if (wacom->parser.data[0] != '~' || wacom->parser.len < 2) {
+		dev_dbg(&wacom->dev->dev, "got a garbled response of length "
+			                  "%d.\n", wacom->parser.len);
+		atomic_long_inc(&wacom->stats.garbled);
+		return;
+	}
+
+	switch (wacom->parser.data[1]) {
+	case '#':
+		/* Once registered, the model is only asked for again to
+		 * check that the tablet is still the same one. */
+		if (wacom->registered)
+			strscpy(wacom->model_string, wacom->parser.data + 2,
+				sizeof(wacom->model_string));
+		else
+			handle_model_response(wacom);
+		wacom->pending &= ~BIT(REQUEST_MODEL);
+		break;
+	case 'R':
+		handle_configuration_response(wacom);
+		wacom->pending &= ~BIT(REQUEST_CONFIGURATION);
+		break;
+	case 'C':
+		handle_coordinates_response(wacom);
+		wacom->pending &= ~BIT(REQUEST_COORDINATES);
+		break;
+	default:
+		dev_dbg(&wacom->dev->dev, "got an unexpected response: %s\n",
+			wacom->parser.data);
+		break;
+	}
+
+	if (!wacom->pending)
+		complete(&wacom->cmd_done);
+}
+
+/* The stylus and eraser can't both be in proximity. */
+static int other_end(int tool)
+{
+	switch (tool) {
+	case WACOM_IV_STYLUS:
+		return WACOM_IV_ERASER;
+	case WACOM_IV_ERASER:
+		return WACOM_IV_STYLUS;
+	default:
+		return 0;
+	}
+}
+
+/* Take every tool out of proximity, and forget what we knew. */
+static void release_tools(struct wacom *wacom)
+{
+	bool any = false;
+	int i;
+
+	for (i = 0; i < WACOM_NTOOLS; i++) {
+		if (!wacom->tool_state[i].in_proximity)
+			continue;
+		if (tools[i].input_id)
+			input_report_key(wacom->dev, tools[i].input_id, 0);
+		any = true;
+	}
+	if (any) {
+		input_report_abs(wacom->dev, ABS_MISC, 0);
+		input_report_key(wacom->dev, BTN_TOUCH, 0);
+		input_report_key(wacom->dev, BTN_STYLUS, 0);
+		input_sync(wacom->dev);
+	}
+	memset(wacom->tool_state, 0, sizeof(wacom->tool_state));
+	memset(wacom->tool_reported, 0, sizeof(wacom->tool_reported));
+	memset(wacom->last_packet, 0, sizeof(wacom->last_packet));
+}
+
+/* byte_time is when the packet's last byte arrived, for the latency
+ * statistics; start is when the tablet began sending it, which is
+ * the closest we can get to when it was sampled. */
+static void report_packet(struct wacom *wacom,
+			  const struct wacom_iv_packet *pkt, int release,
+			  ktime_t byte_time, ktime_t start)
+{
+	if (release)
+		input_report_key(wacom->dev, tools[release].input_id, 0);
+	input_event(wacom->dev, EV_MSC, MSC_SERIAL, tools[pkt->tool].serial);
+	input_event(wacom->dev, EV_MSC, MSC_TIMESTAMP,
+		    (u32)ktime_to_us(start));
+	input_report_key(wacom->dev, tools[pkt->tool].input_id, pkt->in_proximity);
+	input_report_abs(wacom->dev, ABS_MISC, pkt->in_proximity ? tools[pkt->tool].device_id : 0);
+	input_report_abs(wacom->dev, ABS_X, pkt->x);
+	input_report_abs(wacom->dev, ABS_Y, pkt->y);
+	input_report_abs(wacom->dev, ABS_PRESSURE, pkt->z);
+	input_report_key(wacom->dev, BTN_TOUCH, pkt->button & 1);
+	input_report_key(wacom->dev, BTN_STYLUS, pkt->button & 2);
+	input_sync(wacom->dev);
+	hist_add(&wacom->stats.latency, ktime_sub(ktime_get(), byte_time));
+}
+
+/* Report the tool's coalesced packet, if any.  Call with
+ * coalesce_lock held. */
+static bool flush_tool(struct wacom *wacom, int tool)
+{
+	if (!(wacom->coalesce_pending & BIT(tool)))
+		return false;
+	wacom->coalesce_pending &= ~BIT(tool);
+	report_packet(wacom, &wacom->coalesced[tool], 0,
+		      wacom->coalesced_time[tool], wacom->coalesced_start[tool]);
+	return true;
+}
+
+/* Report every tool's coalesced packet.  Call with coalesce_lock
+ * held. */
+static void flush_coalesced(struct wacom *wacom)
+{
+	bool any = false;
+	int i;
+
+	for (i = 0; i < WACOM_NTOOLS; i++)
+		any |= flush_tool(wacom, i);
+	if (any)
+		wacom->next_report = ktime_add(ktime_get(),
+					       wacom->min_interval);
+}
+
+/*
+ * With a maximum output rate, a packet that arrives too soon after
+ * the last frame is merged into the one its tool has waiting for the
+ * coalesce timer: the newest position wins, and the highest pressure
+ * is kept.  Frames are told apart by MSC_SERIAL, so with the pen and
+ * puck taking turns each keeps its own, and each tool gets max_rate.
+ * Proximity and button changes (edges) are never held back; whatever
+ * the tool (or the end it releases) had waiting goes out first, so
+ * nothing is reordered.
+ */
+static void coalesce_packet(struct wacom *wacom, struct wacom_iv_packet *pkt,
+			    int release, bool edge)
+{
+	int tool = pkt->tool;
+	ktime_t now = ktime_get();
+
+	spin_lock_bh(&wacom->coalesce_lock);
+	if (edge) {
+		flush_tool(wacom, tool);
+		if (release)
+			flush_tool(wacom, release);
+	}
+
+	if (edge || ktime_compare(now, wacom->next_report) >= 0) {
+		report_packet(wacom, pkt, release, wacom->byte_time,
+			      wacom->packet_start);
+		wacom->next_report = ktime_add(now, wacom->min_interval);
+	} else {
+		if (wacom->coalesce_pending & BIT(tool))
+			pkt->z = max(pkt->z, wacom->coalesced[tool].z);
+		else if (!wacom->coalesce_pending)
+			hrtimer_start(&wacom->coalesce_timer,
+				      wacom->next_report, HRTIMER_MODE_ABS_SOFT);
+		wacom->coalesced[tool] = *pkt;
+		wacom->coalesced_time[tool] = wacom->byte_time;
+		wacom->coalesced_start[tool] = wacom->packet_start;
+		wacom->coalesce_pending |= BIT(tool);
+		atomic_long_inc(&wacom->stats.coalesced);
+	}
+	spin_unlock_bh(&wacom->coalesce_lock);
+}
+
+static enum hrtimer_restart wacom_coalesce_timer(struct hrtimer *timer)
+{
+	struct wacom *wacom = container_of(timer, struct wacom,
+					   coalesce_timer);
+
+	spin_lock(&wacom->coalesce_lock);
+	flush_coalesced(wacom);
+	spin_unlock(&wacom->coalesce_lock);
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * While calibrating, look for WACOM_CALIBRATION_SAMPLES packets in a
+ * row from the pen hovering with nothing pressed, where only the
+ * sensor's noise moves the readings.  The spread on each axis becomes
+ * its fuzz, and the highest hovering pressure the pressure's flat.
+ * Repeated packets count too, so this runs before they're dropped.
+ */
+static void calibrate_sample(struct wacom *wacom)
+{
+	struct wacom_iv_packet pkt;
+	int v[WACOM_NAXES], i;
+
+	wacom->decoder->decode(wacom->parser.data, &pkt);
+	if (!pkt.in_proximity || pkt.tool != WACOM_IV_STYLUS || pkt.button) {
+		wacom->cal_samples = 0;
+		return;
+	}
+
+	v[AXIS_X] = pkt.x;
+	v[AXIS_Y] = pkt.y;
+	v[AXIS_PRESSURE] = pkt.z;
+	for (i = 0; i < WACOM_NAXES && wacom->cal_samples; i++) {
+		wacom->cal_min[i] = min(wacom->cal_min[i], v[i]);
+		wacom->cal_max[i] = max(wacom->cal_max[i], v[i]);
+		if (wacom->cal_max[i] - wacom->cal_min[i] >
+		    WACOM_CALIBRATION_MAX_NOISE)
+			wacom->cal_samples = 0;
+	}
+	/* First sample, or the pen moved: start over from here. */
+	if (!wacom->cal_samples)
+		for (i = 0; i < WACOM_NAXES; i++)
+			wacom->cal_min[i] = wacom->cal_max[i] = v[i];
+	if (++wacom->cal_samples < WACOM_CALIBRATION_SAMPLES)
+		return;
+
+	wacom->calibrating = false;
+	if (wacom->abs_override)
+		return;
+	for (i = 0; i < WACOM_NAXES; i++)
+		wacom->fuzz[i] = wacom->cal_max[i] - wacom->cal_min[i];
+	wacom->flat[AXIS_PRESSURE] = wacom->cal_max[AXIS_PRESSURE];
+	update_abs(wacom);
+	dev_info(&wacom->dev->dev, "Calibrated: fuzz x %d, y %d, pressure %d; "
+		 "pressure flat %d\n", wacom->fuzz[AXIS_X], wacom->fuzz[AXIS_Y],
+		 wacom->fuzz[AXIS_PRESSURE], wacom->flat[AXIS_PRESSURE]);
+}
+
+/*
+ * Whether every axis is within half its fuzz of what was last
+ * reported for the tool.  The input core would drop all of those
+ * ABS events, but not MSC_SERIAL and MSC_TIMESTAMP, so reporting the
+ * packet would still wake every reader for a frame with nothing in
+ * it.
+ */
+static bool within_fuzz(struct wacom *wacom, const struct wacom_iv_packet *pkt,
+			const struct wacom_iv_packet *reported)
+{
+	return abs(pkt->x - reported->x) <= wacom->fuzz[AXIS_X] / 2 &&
+		abs(pkt->y - reported->y) <= wacom->fuzz[AXIS_Y] / 2 &&
+		abs(pkt->z - reported->z) <= wacom->fuzz[AXIS_PRESSURE] / 2;
+}
+
+static void handle_packet(struct wacom *wacom)
+{
+	struct wacom_iv_packet pkt, *last, *reported;
+	int other;
+	bool edge;
+
+	if (unlikely(wacom->calibrating))
+		calibrate_sample(wacom);
+
+	/* A pen resting in proximity streams identical packets at the
+	 * full rate; none of them would change anything we report. */
+	if (!memcmp(wacom->parser.data, wacom->last_packet,
+		    WACOM_IV_PACKET_LENGTH))
+		return;
+	memcpy(wacom->last_packet, wacom->parser.data, WACOM_IV_PACKET_LENGTH);
+
+	wacom->decoder->decode(wacom->parser.data, &pkt);
+	trace_wacom_packet(wacom->serio, wacom->parser.data, &pkt);
+
+	/* With the pen and puck taking turns, repeats aren't
+	 * back-to-back, so check against the tool's own state too.
+	 * That's the last state seen, which may not have been reported
+	 * yet if it's being coalesced. */
+	last = &wacom->tool_state[pkt.tool];
+	if (!memcmp(&pkt, last, sizeof(pkt)))
+		return;
+
+	/* Each tool keeps its own proximity, and userspace tells their
+	 * frames apart by MSC_SERIAL, so a change of tool costs no
+	 * more than any other frame.  Only flipping the pen over
+	 * releases the other end, in the same frame. */
+	other = other_end(pkt.tool);
+	if (!other || !wacom->tool_state[other].in_proximity)
+		other = 0;
+	else
+		wacom->tool_state[other].in_proximity = 0;
+
+	edge = other || pkt.in_proximity != last->in_proximity ||
+		pkt.button != last->button;
+	*last = pkt;
+
+	/* Nothing but jitter since the tool's last frame.  Packets
+	 * skipped here never differ from it in proximity or buttons,
+	 * as those are edges. */
+	reported = &wacom->tool_reported[pkt.tool];
+	if (!edge && within_fuzz(wacom, &pkt, reported))
+		return;
+	*reported = pkt;
+
+	if (!wacom->min_interval)
+		report_packet(wacom, &pkt, other, wacom->byte_time,
+			      wacom->packet_start);
+	else
+		coalesce_packet(wacom, &pkt, other, edge);
+}
+
+static void wacom_process_byte(struct wacom *wacom, struct wacom_byte b)
+{
+	wacom->byte_time = b.time;
+	hist_add(&wacom->stats.byte_gap,
+		 ktime_sub(b.time, wacom->last_byte_time));
+	wacom->last_byte_time = b.time;
+	/* The same test wacom_iv_parse_byte() uses to start a packet. */
+	if ((b.data & 0x80) && !(b.flags & (SERIO_PARITY | SERIO_FRAME)))
+		wacom->packet_start = ktime_sub(b.time, wacom->byte_line_time);
+
+	switch (wacom_iv_parse_byte(&wacom->parser, b.data,
+				    b.flags & (SERIO_PARITY | SERIO_FRAME))) {
+	case WACOM_IV_OVERFLOW:
+		dev_dbg(&wacom->dev->dev, "throwing away %d bytes of garbage\n",
+			wacom->parser.discarded);
+		atomic_long_inc(&wacom->stats.overflows);
+		break;
+	case WACOM_IV_PACKET:
+		atomic_long_inc(&wacom->stats.packets);
+		hist_add(&wacom->stats.packet_interval,
+			 ktime_sub(b.time, wacom->last_packet_time));
+		wacom->last_packet_time = b.time;
+		handle_packet(wacom);
+		break;
+	case WACOM_IV_RESPONSE:
+		atomic_long_inc(&wacom->stats.responses);
+		handle_response(wacom);
+		break;
+	}
+}
+
+static void wacom_work(struct work_struct *work)
+{
+	struct wacom *wacom = container_of(work, struct wacom, work);
+	struct wacom_byte buf[32];
+	unsigned int i, n;
+
+	mutex_lock(&wacom->lock);
+	while ((n = kfifo_out(&wacom->fifo, buf, ARRAY_SIZE(buf))) > 0) {
+		atomic_long_add(n, &wacom->stats.bytes);
+		for (i = 0; i < n; i++)
+			wacom_process_byte(wacom, buf[i]);
+	}
+	if (wacom->pending)
+		mod_delayed_work(system_wq, &wacom->idle_work, WACOM_IDLE_GAP);
+	mutex_unlock(&wacom->lock);
+}
+
+/* The line has been quiet for WACOM_IDLE_GAP while we were waiting for
+ * responses.  Some tablets (the PenPartner, for example) don't
+ * terminate a response with a carriage return, so whatever we have
+ * is the whole response; and since the tablet answers requests in
+ * order, it isn't going to answer the rest. */
+static void wacom_idle_work(struct work_struct *work)
+{
+	struct wacom *wacom = container_of(to_delayed_work(work),
+					   struct wacom, idle_work);
+
+	mutex_lock(&wacom->lock);
+	if (wacom_iv_parser_flush(&wacom->parser) == WACOM_IV_RESPONSE)
+		handle_response(wacom);
+	if (wacom->pending)
+		complete(&wacom->cmd_done);
+	mutex_unlock(&wacom->lock);
+}
+
+static irqreturn_t wacom_interrupt(struct serio *serio, unsigned char data,
+				   unsigned int flags)
+{
+	struct wacom *wacom = serio_get_drvdata(serio);
+	struct wacom_byte b = {
+		.time = ktime_get(), .data = data, .flags = flags
+	};
+	struct wacom_tap *tap;
+
+	trace_wacom_rx(serio, data, flags);
+	/* serio holds its lock around this, so the tap can't be
+	 * detached under us. */
+	tap = READ_ONCE(wacom->tap);
+	if (tap) {
+		if (!kfifo_put(&tap->fifo, b))
+			atomic_long_inc(&tap->dropped);
+		wake_up_interruptible(&tap->wait);
+	}
+	if (!kfifo_put(&wacom->fifo, b))
+		atomic_long_inc(&wacom->stats.fifo_dropped);
+	queue_work(system_highpri_wq, &wacom->work);
+	return IRQ_HANDLED;
+}
+
+/*
+ * Fuzz and flat for x, y and pressure, in
+ * /sys/bus/serio/devices/serioN/calibration/.  Writing "<x> <y>
+ * <pressure>" to fuzz or flat overrides calibration; writing 1 to
+ * calibrate measures them again from the next hovering samples.
+ */
+static ssize_t show_abs(int *values, char *buf)
+{
+	return sprintf(buf, "%d %d %d\n", values[AXIS_X], values[AXIS_Y],
+		       values[AXIS_PRESSURE]);
+}
+
+static ssize_t store_abs(struct wacom *wacom, int *values, const char *buf,
+			 size_t count)
+{
+	int v[WACOM_NAXES], i;
+
+	if (sscanf(buf, "%d %d %d", &v[AXIS_X], &v[AXIS_Y],
+		   &v[AXIS_PRESSURE]) != WACOM_NAXES)
+		return -EINVAL;
+	for (i = 0; i < WACOM_NAXES; i++)
+		if (v[i] < 0)
+			return -EINVAL;
+
+	mutex_lock(&wacom->lock);
+	memcpy(values, v, sizeof(v));
+	wacom->abs_override = true;
+	wacom->calibrating = false;
+	update_abs(wacom);
+	mutex_unlock(&wacom->lock);
+	return count;
+}
+
+static ssize_t fuzz_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct wacom *wacom = serio_get_drvdata(to_serio_port(dev));
+
+	return show_abs(wacom->fuzz, buf);
+}
+
+static ssize_t fuzz_store(struct device *dev, struct device_attribute *attr,
+			  const char *buf, size_t count)
+{
+	struct wacom *wacom = serio_get_drvdata(to_serio_port(dev));
+
+	return store_abs(wacom, wacom->fuzz, buf, count);
+}
+static DEVICE_ATTR_RW(fuzz);
+
+static ssize_t flat_show(struct device *dev, struct device_attribute *attr,
+			 char *buf)
+{
+	struct wacom *wacom = serio_get_drvdata(to_serio_port(dev));
+
+	return show_abs(wacom->flat, buf);
+}
+
+static ssize_t flat_store(struct device *dev, struct device_attribute *attr,
+			  const char *buf, size_t count)
+{
+	struct wacom *wacom = serio_get_drvdata(to_serio_port(dev));
+
+	return store_abs(wacom, wacom->flat, buf, count);
+}
+static DEVICE_ATTR_RW(flat);
+
+static ssize_t calibrate_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct wacom *wacom = serio_get_drvdata(to_serio_port(dev));
+
+	return sprintf(buf, "%d\n", wacom->calibrating);
+}
+
+static ssize_t calibrate_store(struct device *dev,
+			       struct device_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct wacom *wacom = serio_get_drvdata(to_serio_port(dev));
+	bool on;
+	int err;
+
+	err = kstrtobool(buf, &on);
+	if (err)
+		return err;
+
+	mutex_lock(&wacom->lock);
+	wacom->calibrating = on;
+	wacom->cal_samples = 0;
+	if (on)
+		wacom->abs_override = false;
+	mutex_unlock(&wacom->lock);
+	return count;
+}
+static DEVICE_ATTR_RW(calibrate);
+
+static struct attribute *wacom_calibration_attrs[] = {
+	&dev_attr_fuzz.attr,
+	&dev_attr_flat.attr,
+	&dev_attr_calibrate.attr,
+	NULL
+};
+
+static const struct attribute_group wacom_calibration_group = {
+	.name	= "calibration",
+	.attrs	= wacom_calibration_attrs,
+};
+
+/*
+ * Maximum frames per second for each tool, or 0 for no limit, in
+ * /sys/bus/serio/devices/serioN/output/max_rate.
+ */
+static void set_max_rate(struct wacom *wacom, unsigned int rate)
+{
+	wacom->min_interval = rate ? ns_to_ktime(NSEC_PER_SEC / rate) : 0;
+}
+
+static ssize_t max_rate_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct wacom *wacom = serio_get_drvdata(to_serio_port(dev));
+	s64 interval = ktime_to_ns(wacom->min_interval);
+
+	return sprintf(buf, "%llu\n",
+		       interval ? div64_u64(NSEC_PER_SEC, interval) : 0);
+}
+
+static ssize_t max_rate_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct wacom *wacom = serio_get_drvdata(to_serio_port(dev));
+	unsigned int rate;
+	int err;
+
+	err = kstrtouint(buf, 0, &rate);
+	if (err)
+		return err;
+
+	mutex_lock(&wacom->lock);
+	set_max_rate(wacom, rate);
+	/* Don't leave a packet waiting on the old rate. */
+	hrtimer_cancel(&wacom->coalesce_timer);
+	spin_lock_bh(&wacom->coalesce_lock);
+	flush_coalesced(wacom);
+	spin_unlock_bh(&wacom->coalesce_lock);
+	mutex_unlock(&wacom->lock);
+	return count;
+}
+static DEVICE_ATTR_RW(max_rate);
+
+static struct attribute *wacom_output_attrs[] = {
+	&dev_attr_max_rate.attr,
+	NULL
+};
+
+static const struct attribute_group wacom_output_group = {
+	.name	= "output",
+	.attrs	= wacom_output_attrs,
+};
+
+static const struct attribute_group *wacom_groups[] = {
+	&wacom_calibration_group,
+	&wacom_output_group,
+	NULL
+};
+
+static struct dentry *wacom_debugfs_root;
+
+/* Serializes attaching and detaching taps, which can be closed after
+ * their port (and struct wacom) is gone. */
+static DEFINE_MUTEX(wacom_tap_lock);
+
+static void show_hist(struct seq_file *m, const char *name,
+		      struct wacom_hist *h)
+{
+	int i;
+
+	seq_printf(m, "%s:\n", name);
+	for (i = 0; i < WACOM_HIST_BUCKETS; i++)
+		seq_printf(m, "  %s%8lu us: %lu\n",
+			   i == WACOM_HIST_BUCKETS - 1 ? ">=" : " <",
+			   i == WACOM_HIST_BUCKETS - 1 ? 1UL << (i - 1) : 1UL << i,
+			   atomic_long_read(&h->bucket[i]));
+}
+
+static int wacom_stats_show(struct seq_file *m, void *v)
+{
+	struct wacom *wacom = m->private;
+	struct wacom_stats *st = &wacom->stats;
+
+	seq_printf(m, "bytes: %lu\n", atomic_long_read(&st->bytes));
+	seq_printf(m, "packets: %lu\n", atomic_long_read(&st->packets));
+	seq_printf(m, "responses: %lu\n", atomic_long_read(&st->responses));
+	seq_printf(m, "garbled_responses: %lu\n",
+		   atomic_long_read(&st->garbled));
+	seq_printf(m, "overflows: %lu\n", atomic_long_read(&st->overflows));
+	seq_printf(m, "coalesced: %lu\n", atomic_long_read(&st->coalesced));
+	/* Bytes lost to noise, and to the fifo overflowing, count
+	 * alike. */
+	seq_printf(m, "dropped_bytes: %lu\n", wacom->parser.dropped_bytes +
+		   atomic_long_read(&st->fifo_dropped));
+	seq_printf(m, "discarded_packets: %lu\n",
+		   wacom->parser.discarded_packets);
+	seq_printf(m, "resyncs: %lu\n", wacom->parser.resyncs);
+	show_hist(m, "byte_gap", &st->byte_gap);
+	show_hist(m, "packet_interval", &st->packet_interval);
+	show_hist(m, "latency", &st->latency);
+	return 0;
+}
+
+static int wacom_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wacom_stats_show, inode->i_private);
+}
+
+static ssize_t wacom_stats_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	struct wacom *wacom = ((struct seq_file *)file->private_data)->private;
+	atomic_long_t *c = (atomic_long_t *)&wacom->stats;
+	int i;
+
+	for (i = 0; i < sizeof(wacom->stats) / sizeof(*c); i++)
+		atomic_long_set(&c[i], 0);
+
+	mutex_lock(&wacom->lock);
+	wacom->parser.dropped_bytes = 0;
+	wacom->parser.discarded_packets = 0;
+	wacom->parser.resyncs = 0;
+	mutex_unlock(&wacom->lock);
+	return count;
+}
+
+static const struct file_operations wacom_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= wacom_stats_open,
+	.read		= seq_read,
+	.write		= wacom_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* Stop wacom_interrupt() filling the tap, and let its reader see the
+ * end of the stream.  Call with wacom_tap_lock held. */
+static void wacom_tap_detach(struct wacom_tap *tap)
+{
+	struct wacom *wacom = tap->wacom;
+
+	if (!wacom)
+		return;
+	serio_pause_rx(wacom->serio);
+	wacom->tap = NULL;
+	serio_continue_rx(wacom->serio);
+	WRITE_ONCE(tap->wacom, NULL);
+	wake_up_interruptible(&tap->wait);
+}
+
+static int wacom_tap_open(struct inode *inode, struct file *file)
+{
+	struct wacom *wacom = inode->i_private;
+	struct wacom_tap *tap;
+	int err = 0;
+
+	tap = kvzalloc(sizeof(*tap), GFP_KERNEL);
+	if (!tap)
+		return -ENOMEM;
+	INIT_KFIFO(tap->fifo);
+	init_waitqueue_head(&tap->wait);
+	mutex_init(&tap->lock);
+	tap->wacom = wacom;
+
+	mutex_lock(&wacom_tap_lock);
+	if (wacom->tap_disabled) {
+		err = -ENODEV;
+	} else if (wacom->tap) {
+		err = -EBUSY;
+	} else {
+		serio_pause_rx(wacom->serio);
+		wacom->tap = tap;
+		serio_continue_rx(wacom->serio);
+	}
+	mutex_unlock(&wacom_tap_lock);
+	if (err) {
+		kvfree(tap);
+		return err;
+	}
+
+	file->private_data = tap;
+	return nonseekable_open(inode, file);
+}
+
+static int wacom_tap_release(struct inode *inode, struct file *file)
+{
+	struct wacom_tap *tap = file->private_data;
+
+	mutex_lock(&wacom_tap_lock);
+	wacom_tap_detach(tap);
+	mutex_unlock(&wacom_tap_lock);
+	kvfree(tap);
+	return 0;
+}
+
+static bool wacom_tap_ready(struct wacom_tap *tap)
+{
+	return !kfifo_is_empty(&tap->fifo) || !READ_ONCE(tap->wacom);
+}
+
+static int wacom_tap_line(char *line, size_t size, struct wacom_byte b)
+{
+	return scnprintf(line, size, "%lld %02x%s%s\n", ktime_to_ns(b.time),
+			 b.data, b.flags & SERIO_PARITY ? " parity" : "",
+			 b.flags & SERIO_FRAME ? " frame" : "");
+}
+
+/* Returns 0 once the port is gone and everything has been read. */
+static ssize_t wacom_tap_read(struct file *file, char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct wacom_tap *tap = file->private_data;
+	struct wacom_byte b;
+	char line[48];
+	ssize_t done = 0;
+	long dropped;
+	int len, err;
+
+	err = mutex_lock_interruptible(&tap->lock);
+	if (err)
+		return err;
+
+	while (kfifo_is_empty(&tap->fifo) && READ_ONCE(tap->wacom)) {
+		if (file->f_flags & O_NONBLOCK) {
+			err = -EAGAIN;
+			goto out;
+		}
+		err = wait_event_interruptible(tap->wait,
+					       wacom_tap_ready(tap));
+		if (err)
+			goto out;
+	}
+
+	dropped = atomic_long_xchg(&tap->dropped, 0);
+	if (dropped) {
+		len = scnprintf(line, sizeof(line), "dropped %ld\n", dropped);
+		if (len > count || copy_to_user(buf, line, len)) {
+			atomic_long_add(dropped, &tap->dropped);
+			err = len > count ? -EINVAL : -EFAULT;
+			goto out;
+		}
+		done = len;
+	}
+
+	while (kfifo_peek(&tap->fifo, &b)) {
+		len = wacom_tap_line(line, sizeof(line), b);
+		if (len > count - done)
+			break;
+		if (copy_to_user(buf + done, line, len)) {
+			err = -EFAULT;
+			break;
+		}
+		kfifo_skip(&tap->fifo);
+		done += len;
+	}
+	/* Too small for even one line. */
+	if (!done && !err && !kfifo_is_empty(&tap->fifo))
+		err = -EINVAL;
+
+ out:	mutex_unlock(&tap->lock);
+	return done ? done : err;
+}
+
+static __poll_t wacom_tap_poll(struct file *file, poll_table *wait)
+{
+	struct wacom_tap *tap = file->private_data;
+
+	poll_wait(file, &tap->wait, wait);
+	return wacom_tap_ready(tap) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static const struct file_operations wacom_tap_fops = {
+	.owner		= THIS_MODULE,
+	.open		= wacom_tap_open,
+	.read		= wacom_tap_read,
+	.poll		= wacom_tap_poll,
+	.release	= wacom_tap_release,
+};
+
+/* No more taps; the reader of any open one gets end of file. */
+static void wacom_tap_disable(struct wacom *wacom)
+{
+	mutex_lock(&wacom_tap_lock);
+	wacom->tap_disabled = true;
+	if (wacom->tap)
+		wacom_tap_detach(wacom->tap);
+	mutex_unlock(&wacom_tap_lock);
+}
+
+static void wacom_disconnect(struct serio *serio)
+{
+	struct wacom *wacom = serio_get_drvdata(serio);
+
+	sysfs_remove_groups(&serio->dev.kobj, wacom_groups);
+	/* Before removing debugfs, which waits for a blocked read. */
+	wacom_tap_disable(wacom);
+	debugfs_remove_recursive(wacom->debugfs);
+	serio_close(serio);
+	cancel_work_sync(&wacom->work);
+	cancel_delayed_work_sync(&wacom->idle_work);
+	hrtimer_cancel(&wacom->coalesce_timer);
+	serio_set_drvdata(serio, NULL);
+	input_unregister_device(wacom->dev);
+	kfree(wacom);
+}
+
+static int wacom_send(struct serio *serio, const char *command)
+{
+	int err = 0;
+
+	trace_wacom_send(serio, command);
+	for (; !err && *command; command++)
+		err = serio_write(serio, *command);
+	return err;
+}
+
+/* Ends with the tablet quiet, even if it came back from a power
+ * cycle (or was set up by a quirk) streaming; wacom_open() starts
+ * it. */
+static int send_setup_string(struct wacom *wacom, struct serio *serio)
+{
+	int err;
+
+	err = wacom_send(serio, wacom->model->setup);
+	if (!err)
+		err = wacom_send(serio, COMMAND_STOP_SENDING_PACKETS);
+	return err;
+}
+
+/* The tablet is set up at probe time, but only streams packets while
+ * someone has the input device open.  The input core calls these
+ * with dev->mutex held. */
+static int wacom_open(struct input_dev *dev)
+{
+	struct wacom *wacom = input_get_drvdata(dev);
+
+	return wacom_send(wacom->serio, COMMAND_START_SENDING_PACKETS);
+}
+
+static void wacom_close(struct input_dev *dev)
+{
+	struct wacom *wacom = input_get_drvdata(dev);
+
+	wacom_send(wacom->serio, COMMAND_STOP_SENDING_PACKETS);
+
+	/* No more packets are coming to take the tools out of
+	 * proximity. */
+	mutex_lock(&wacom->lock);
+	hrtimer_cancel(&wacom->coalesce_timer);
+	wacom->coalesce_pending = 0;
+	release_tools(wacom);
+	mutex_unlock(&wacom->lock);
+}
+
+static const char * const request_strings[] = {
+	[REQUEST_MODEL]		= REQUEST_MODEL_AND_ROM_VERSION,
+	[REQUEST_CONFIGURATION]	= REQUEST_CONFIGURATION_STRING,
+	[REQUEST_COORDINATES]	= REQUEST_MAX_COORDINATES,
+};
+
+/* Send all the given requests at once and wait for the answers.  The
+ * responses are told apart by their prefix, and wacom_idle_work()
+ * ends the wait as soon as the tablet goes quiet, so a tablet that
+ * doesn't answer some of them costs us WACOM_IDLE_GAP rather than a
+ * full timeout per request.  Returns the requests left unanswered. */
+static long wacom_request(struct wacom *wacom, struct serio *serio,
+			  unsigned long requests)
+{
+	unsigned long pending;
+	int i, err = 0;
+
+	mutex_lock(&wacom->lock);
+	reinit_completion(&wacom->cmd_done);
+	wacom->pending = requests;
+	mutex_unlock(&wacom->lock);
+
+	for (i = 0; i < ARRAY_SIZE(request_strings); i++) {
+		if (!(requests & BIT(i)))
+			continue;
+		err = wacom_send(serio, request_strings[i]);
+		if (err)
+			break;
+	}
+	if (!err)
+		wait_for_completion_timeout(&wacom->cmd_done, HZ);
+
+	mutex_lock(&wacom->lock);
+	pending = wacom->pending;
+	wacom->pending = 0;
+	mutex_unlock(&wacom->lock);
+	cancel_delayed_work_sync(&wacom->idle_work);
+
+	return err ? err : pending;
+}
+
+/*
+ * Probe results, so that re-attaching a tablet we've seen before only
+ * costs a model request.  Entries are keyed by serio phys path and
+ * model string, and can be preloaded or read back through the "cache"
+ * module parameter, one entry per line (or ';'-separated):
+ *
+ *   <phys>|<model string>|<max x>,<max y>,<x res>,<y res>
+ *
+ * for example "ttyS0/serio0|CT-0045R V1.3-5|5103,3711,1000,1000".
+ * Writing an empty string empties the cache.
+ */
+struct wacom_cache_entry {
+	struct list_head node;
+	char phys[32];
+	char model[WACOM_IV_BUFFER_SIZE];
+	int max_x, max_y, res_x, res_y;
+};
+
+static LIST_HEAD(wacom_cache);
+static DEFINE_MUTEX(wacom_cache_lock);
+
+/* Called with wacom_cache_lock held. */
+static struct wacom_cache_entry *wacom_cache_find(const char *phys,
+						  const char *model)
+{
+	struct wacom_cache_entry *e;
+
+	list_for_each_entry(e, &wacom_cache, node)
+		if (!strcmp(e->phys, phys) && !strcmp(e->model, model))
+			return e;
+	return NULL;
+}
+
+static int wacom_cache_add(const char *phys, const char *model,
+			   int max_x, int max_y, int res_x, int res_y)
+{
+	struct wacom_cache_entry *e;
+
+	if (strlen(phys) >= sizeof(e->phys) ||
+	    strlen(model) >= sizeof(e->model))
+		return -EINVAL;
+
+	mutex_lock(&wacom_cache_lock);
+	e = wacom_cache_find(phys, model);
+	if (!e) {
+		e = kzalloc(sizeof(*e), GFP_KERNEL);
+		if (!e) {
+			mutex_unlock(&wacom_cache_lock);
+			return -ENOMEM;
+		}
+		strscpy(e->phys, phys, sizeof(e->phys));
+		strscpy(e->model, model, sizeof(e->model));
+		list_add(&e->node, &wacom_cache);
+	}
+	e->max_x = max_x;
+	e->max_y = max_y;
+	e->res_x = res_x;
+	e->res_y = res_y;
+	mutex_unlock(&wacom_cache_lock);
+	return 0;
+}
+
+static void wacom_cache_clear(void)
+{
+	struct wacom_cache_entry *e, *next;
+
+	mutex_lock(&wacom_cache_lock);
+	list_for_each_entry_safe(e, next, &wacom_cache, node) {
+		list_del(&e->node);
+		kfree(e);
+	}
+	mutex_unlock(&wacom_cache_lock);
+}
+
+static int wacom_cache_set(const char *val, const struct kernel_param *kp)
+{
+	char *buf, *s, *entry, *phys, *model;
+	int max_x, max_y, res_x, res_y;
+	int err = 0;
+
+	buf = kstrdup(val, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	s = strim(buf);
+	if (!*s)
+		wacom_cache_clear();
+	while (!err && (entry = strsep(&s, ";\n")) != NULL) {
+		if (!*entry)
+			continue;
+		phys = strsep(&entry, "|");
+		model = strsep(&entry, "|");
+		if (!entry || sscanf(entry, "%d,%d,%d,%d", &max_x, &max_y,
+				     &res_x, &res_y) != 4)
+			err = -EINVAL;
+		else
+			err = wacom_cache_add(phys, model, max_x, max_y,
+					      res_x, res_y);
+	}
+	kfree(buf);
+	return err;
+}
+
+static int wacom_cache_get(char *buffer, const struct kernel_param *kp)
+{
+	struct wacom_cache_entry *e;
+	int len = 0;
+
+	mutex_lock(&wacom_cache_lock);
+	list_for_each_entry(e, &wacom_cache, node)
+		len += scnprintf(buffer + len, PAGE_SIZE - len,
+				 "%s|%s|%d,%d,%d,%d\n", e->phys, e->model,
+				 e->max_x, e->max_y, e->res_x, e->res_y);
+	mutex_unlock(&wacom_cache_lock);
+	return len;
+}
+
+static const struct kernel_param_ops wacom_cache_ops = {
+	.set	= wacom_cache_set,
+	.get	= wacom_cache_get,
+};
+module_param_cb(cache, &wacom_cache_ops, NULL, 0644);
+MODULE_PARM_DESC(cache, "Known tablets: <phys>|<model>|<max x>,<max y>,"
+		 "<x res>,<y res>, ';'-separated");
+
+static bool wacom_cache_lookup(struct wacom *wacom)
+{
+	struct wacom_cache_entry *e;
+
+	mutex_lock(&wacom_cache_lock);
+	e = wacom_cache_find(wacom->serio->phys, wacom->model_string);
+	if (e) {
+		set_abs_max(wacom, AXIS_X, e->max_x);
+		set_abs_max(wacom, AXIS_Y, e->max_y);
+		input_abs_set_res(wacom->dev, ABS_X, e->res_x);
+		input_abs_set_res(wacom->dev, ABS_Y, e->res_y);
+	}
+	mutex_unlock(&wacom_cache_lock);
+	return e != NULL;
+}
+
+static void wacom_cache_store(struct wacom *wacom)
+{
+	wacom_cache_add(wacom->serio->phys, wacom->model_string,
+			input_abs_get_max(wacom->dev, ABS_X),
+			input_abs_get_max(wacom->dev, ABS_Y),
+			input_abs_get_res(wacom->dev, ABS_X),
+			input_abs_get_res(wacom->dev, ABS_Y));
+}
+
+static int wacom_setup(struct wacom *wacom, struct serio *serio)
+{
+	long pending;
+
+	/* Note that setting the link speed is the job of inputattach.
+	 * We assume that reset negotiation has already happened,
+	 * here. */
+	pending = wacom_request(wacom, serio, BIT(REQUEST_MODEL));
+	if (pending < 0)
+		return pending;
+	if (pending) {
+		dev_info(&wacom->dev->dev, "Timed out waiting for tablet to "
+			 "respond with model and version.\n");
+		return -EIO;
+	}
+
+	/* We've seen this tablet on this port before, and the model
+	 * response confirms it's still the same one. */
+	if (wacom_cache_lookup(wacom)) {
+		dev_dbg(&wacom->dev->dev, "Using cached configuration.\n");
+		return send_setup_string(wacom, serio);
+	}
+
+	/* Only ask what the model is known to answer. */
+	pending = (BIT(REQUEST_CONFIGURATION) | BIT(REQUEST_COORDINATES)) &
+		~wacom->model->skip;
+	if (pending)
+		pending = wacom_request(wacom, serio, pending);
+	if (pending < 0)
+		return pending;
+	if (pending & BIT(REQUEST_CONFIGURATION))
+		dev_info(&wacom->dev->dev, "Timed out waiting for tablet to "
+			 "respond with configuration string.  Continuing anyway.\n");
+	if (pending & BIT(REQUEST_COORDINATES))
+		dev_info(&wacom->dev->dev, "Timed out waiting for tablet to "
+			 "respond with coordinates string.  Continuing anyway.\n");
+
+	/* Only what the tablet (or the table, for what it was never
+	 * asked) actually told us; a timeout is worth asking again. */
+	if (!pending)
+		wacom_cache_store(wacom);
+	return send_setup_string(wacom, serio);
+}
+
+/* Probing takes a few round trips at 9600 baud; the driver asks for
+ * asynchronous probing, so this doesn't hold up the serio thread (or
+ * boot). */
+static int wacom_probe(struct wacom *wacom)
+{
+	int err;
+
+	/* Optional, so don't let the firmware loader complain. */
+	if (request_firmware_direct(&wacom->quirks, WACOM_MODELS_FIRMWARE,
+				    &wacom->serio->dev))
+		wacom->quirks = NULL;
+	err = wacom_setup(wacom, wacom->serio);
+	release_firmware(wacom->quirks);
+	wacom->quirks = NULL;
+	if (err)
+		return err;
+
+	err = input_register_device(wacom->dev);
+	if (err)
+		return err;
+	wacom->registered = true;
+	return 0;
+}
+
+static int wacom_connect(struct serio *serio, struct serio_driver *drv)
+{
+	struct wacom *wacom;
+	struct input_dev *input_dev;
+	int baud, err = -ENOMEM;
+
+	if (serio->id.proto != SERIO_WACOM_IV && !userio)
+		return -ENODEV;
+
+	wacom = kzalloc(sizeof(struct wacom), GFP_KERNEL);
+	input_dev = input_allocate_device();
+	if (!wacom || !input_dev)
+		goto fail0;
+
+	wacom->dev = input_dev;
+	wacom->serio = serio;
+	wacom->extra_z_bits = 1;
+	wacom->decoder = wacom_iv_get_decoder(1);
+	wacom->calibrating = calibrate;
+	wacom_iv_parser_reset(&wacom->parser);
+	INIT_KFIFO(wacom->fifo);
+	INIT_WORK(&wacom->work, wacom_work);
+	INIT_DELAYED_WORK(&wacom->idle_work, wacom_idle_work);
+	init_completion(&wacom->cmd_done);
+	mutex_init(&wacom->lock);
+	spin_lock_init(&wacom->coalesce_lock);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&wacom->coalesce_timer, wacom_coalesce_timer,
+		      CLOCK_MONOTONIC, HRTIMER_MODE_ABS_SOFT);
+#else
+	hrtimer_init(&wacom->coalesce_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_ABS_SOFT);
+	wacom->coalesce_timer.function = wacom_coalesce_timer;
+#endif
+	set_max_rate(wacom, max_rate);
+	/* inputattach passes the line speed it settled on, in units of
+	 * 1200 baud, or nothing if it's too old to know; a byte takes
+	 * 10 bits on the wire. */
+	baud = serio->id.id ? serio->id.id * 1200 : 9600;
+	wacom->byte_line_time = ns_to_ktime(NSEC_PER_SEC * 10 / baud);
+	snprintf(wacom->phys, sizeof(wacom->phys), "%s/input0", serio->phys);
+
+	input_dev->name = DEVICE_NAME;
+	input_dev->phys = wacom->phys;
+	input_dev->id.bustype = BUS_RS232;
+	input_dev->id.vendor  = SERIO_WACOM_IV;
+	input_dev->id.product = serio->id.extra;
+	input_dev->id.version = 0x0100;
+	input_dev->dev.parent = &serio->dev;
+	input_dev->open = wacom_open;
+	input_dev->close = wacom_close;
+	input_set_drvdata(input_dev, wacom);
+
+	input_dev->evbit[0] = BIT_MASK(EV_KEY) | BIT_MASK(EV_ABS);
+	__set_bit(BTN_TOOL_PEN, input_dev->keybit);
+	__set_bit(BTN_TOOL_RUBBER, input_dev->keybit);
+	__set_bit(BTN_TOOL_MOUSE, input_dev->keybit);
+	__set_bit(BTN_TOUCH, input_dev->keybit);
+	__set_bit(BTN_STYLUS, input_dev->keybit);
+	input_set_capability(input_dev, EV_MSC, MSC_SERIAL);
+	input_set_capability(input_dev, EV_MSC, MSC_TIMESTAMP);
+	input_set_abs_params(input_dev, ABS_MISC, 0, 0, 0, 0);
+
+	serio_set_drvdata(serio, wacom);
+
+	err = sysfs_create_groups(&serio->dev.kobj, wacom_groups);
+	if (err)
+		goto fail1;
+
+	wacom->debugfs = debugfs_create_dir(dev_name(&serio->dev),
+					    wacom_debugfs_root);
+	debugfs_create_file("stats", 0600, wacom->debugfs, wacom,
+			    &wacom_stats_fops);
+	debugfs_create_file("tap", 0400, wacom->debugfs, wacom,
+			    &wacom_tap_fops);
+
+	err = serio_open(serio, drv);
+	if (err)
+		goto fail2;
+
+	err = wacom_probe(wacom);
+	if (err)
+		goto fail3;
+	return 0;
+
+ fail3:	serio_close(serio);
+	cancel_work_sync(&wacom->work);
+	cancel_delayed_work_sync(&wacom->idle_work);
+	hrtimer_cancel(&wacom->coalesce_timer);
+ fail2:	wacom_tap_disable(wacom);
+	debugfs_remove_recursive(wacom->debugfs);
+	sysfs_remove_groups(&serio->dev.kobj, wacom_groups);
+ fail1:	serio_set_drvdata(serio, NULL);
+ fail0:	input_free_device(input_dev);
+	kfree(wacom);
+	return err;
+}
+
+/*
+ * After a resume or a serio rescan.  If the same tablet answers the
+ * model query, keep the input device and everything we probed, and
+ * only send the setup string again; otherwise fail, and serio probes
+ * the port from scratch.
+ */
+static int wacom_reconnect(struct serio *serio)
+{
+	struct wacom *wacom = serio_get_drvdata(serio);
+	char model[sizeof(wacom->model_string)];
+	long pending;
+	int err;
+
+	if (!wacom)
+		return -ENODEV;
+
+	/* Keep wacom_open() and wacom_close() from sending ST or SP
+	 * into the middle of this. */
+	mutex_lock(&wacom->dev->mutex);
+
+	/* Whatever was in proximity may have left while we weren't
+	 * listening. */
+	mutex_lock(&wacom->lock);
+	hrtimer_cancel(&wacom->coalesce_timer);
+	wacom->coalesce_pending = 0;
+	release_tools(wacom);
+	mutex_unlock(&wacom->lock);
+
+	strscpy(model, wacom->model_string, sizeof(model));
+	pending = wacom_request(wacom, serio, BIT(REQUEST_MODEL));
+	if (pending < 0) {
+		err = pending;
+		goto out;
+	}
+	if (pending || strcmp(model, wacom->model_string)) {
+		dev_info(&wacom->dev->dev, "Tablet changed or not answering; "
+			 "probing again.\n");
+		err = -ENODEV;
+		goto out;
+	}
+
+	err = send_setup_string(wacom, serio);
+	if (!err && wacom->dev->users)
+		err = wacom_send(serio, COMMAND_START_SENDING_PACKETS);
+ out:	mutex_unlock(&wacom->dev->mutex);
+	return err;
+}
+
+static struct serio_device_id wacom_serio_ids[] = {
+	{
+		.type	= SERIO_RS232,
+		.proto	= SERIO_WACOM_IV,
+		.id	= SERIO_ANY,
+		.extra	= SERIO_ANY,
+	},
+	{
+		/* Only taken with the userio parameter */
+		.type	= SERIO_RS232,
+		.proto	= 0,
+		.id	= SERIO_ANY,
+		.extra	= SERIO_ANY,
+	},
+	{ 0 }
+};
+
+MODULE_DEVICE_TABLE(serio, wacom_serio_ids);
+
+static struct serio_driver wacom_drv = {
+	.driver		= {
+		.name	= "wacom_serial",
+		/* Each port's probe waits on its tablet; let them
+		 * overlap. */
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+	},
+	.description	= DRIVER_DESC,
+	.id_table	= wacom_serio_ids,
+	.interrupt	= wacom_interrupt,
+	.connect	= wacom_connect,
+	.reconnect	= wacom_reconnect,
+	.disconnect	= wacom_disconnect,
+};
+
+static int __init wacom_init(void)
+{
+	int err;
+
+	wacom_debugfs_root = debugfs_create_dir("wacom_serial", NULL);
+	err = serio_register_driver(&wacom_drv);
+	if (err)
+		debugfs_remove_recursive(wacom_debugfs_root);
+	return err;
+}
+
+static void __exit wacom_exit(void)
+{
+	serio_unregister_driver(&wacom_drv);
+	debugfs_remove_recursive(wacom_debugfs_root);
+	wacom_cache_clear();
+}
+
+module_init(wacom_init);
+module_exit(wacom_exit);
@@ -0,0 +1,112 @@
+/*
+ * Trace events for the Wacom protocol 4 serial tablet driver
+ *
+ * For example:
+ *   echo 1 > /sys/kernel/debug/tracing/events/wacom_serial/enable
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM wacom_serial
+
+#if !defined(_WACOM_SERIAL_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _WACOM_SERIAL_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/serio.h>
+
+#include "wacom_iv.h"
+
+#define WACOM_TRACE_PORT_LEN	16
+
+TRACE_EVENT(wacom_rx,
+	TP_PROTO(struct serio *serio, unsigned char data, unsigned int flags),
+	TP_ARGS(serio, data, flags),
+	TP_STRUCT__entry(
+		__array(char, port, WACOM_TRACE_PORT_LEN)
+		__field(unsigned char, data)
+		__field(unsigned int, flags)
+	),
+	TP_fast_assign(
+		strscpy(__entry->port, dev_name(&serio->dev),
+			WACOM_TRACE_PORT_LEN);
+		__entry->data = data;
+		__entry->flags = flags;
+	),
+	TP_printk("%s data=%02x flags=%x", __entry->port, __entry->data,
+		  __entry->flags)
+);
+
+TRACE_EVENT(wacom_packet,
+	TP_PROTO(struct serio *serio, const unsigned char *raw,
+		 const struct wacom_iv_packet *pkt),
+	TP_ARGS(serio, raw, pkt),
+	TP_STRUCT__entry(
+		__array(char, port, WACOM_TRACE_PORT_LEN)
+		__array(unsigned char, raw, WACOM_IV_PACKET_LENGTH)
+		__field(int, x)
+		__field(int, y)
+		__field(int, z)
+		__field(int, button)
+		__field(int, tool)
+		__field(int, in_proximity)
+	),
+	TP_fast_assign(
+		strscpy(__entry->port, dev_name(&serio->dev),
+			WACOM_TRACE_PORT_LEN);
+		memcpy(__entry->raw, raw, WACOM_IV_PACKET_LENGTH);
+		__entry->x = pkt->x;
+		__entry->y = pkt->y;
+		__entry->z = pkt->z;
+		__entry->button = pkt->button;
+		__entry->tool = pkt->tool;
+		__entry->in_proximity = !!pkt->in_proximity;
+	),
+	TP_printk("%s raw=%s x=%d y=%d z=%d button=%x tool=%d prox=%d",
+		  __entry->port,
+		  __print_hex(__entry->raw, WACOM_IV_PACKET_LENGTH),
+		  __entry->x, __entry->y, __entry->z, __entry->button,
+		  __entry->tool, __entry->in_proximity)
+);
+
+TRACE_EVENT(wacom_response,
+	TP_PROTO(struct serio *serio, const unsigned char *response, int len),
+	TP_ARGS(serio, response, len),
+	TP_STRUCT__entry(
+		__array(char, port, WACOM_TRACE_PORT_LEN)
+		__array(char, response, WACOM_IV_BUFFER_SIZE + 1)
+		__field(int, len)
+	),
+	TP_fast_assign(
+		strscpy(__entry->port, dev_name(&serio->dev),
+			WACOM_TRACE_PORT_LEN);
+		strscpy(__entry->response, response,
+			WACOM_IV_BUFFER_SIZE + 1);
+		__entry->len = len;
+	),
+	TP_printk("%s len=%d \"%s\"", __entry->port, __entry->len,
+		  __entry->response)
+);
+
+/* Commands contain carriage returns; they show up as-is. */
+TRACE_EVENT(wacom_send,
+	TP_PROTO(struct serio *serio, const char *command),
+	TP_ARGS(serio, command),
+	TP_STRUCT__entry(
+		__array(char, port, WACOM_TRACE_PORT_LEN)
+		__array(char, command, 64)
+	),
+	TP_fast_assign(
+		strscpy(__entry->port, dev_name(&serio->dev),
+			WACOM_TRACE_PORT_LEN);
+		strscpy(__entry->command, command, 64);
+	),
+	TP_printk("%s \"%s\"", __entry->port, __entry->command)
+);
+
+#endif /* _WACOM_SERIAL_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE wacom_serial_trace
+#include <trace/define_trace.h>